@@ -0,0 +1,204 @@
+#include "Affine.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define AFFINE_SSE
+#include <emmintrin.h>
+#endif
+
+#ifdef AFFINE_SSE
+namespace {
+	__m128 load(glm::vec4 const &v) { return _mm_loadu_ps(&v.x); }
+	void store(glm::vec4 *v, __m128 m) { _mm_storeu_ps(&v->x, m); }
+	#define SPLAT(V, I) _mm_shuffle_ps((V), (V), _MM_SHUFFLE(I, I, I, I))
+	//cross product of the xyz parts (w of the result is a.w * b.w - a.w * b.w):
+	__m128 cross(__m128 a, __m128 b) {
+		__m128 a_yzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+		__m128 b_yzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+		__m128 c = _mm_sub_ps(_mm_mul_ps(a, b_yzx), _mm_mul_ps(a_yzx, b)); //(zx-order cross product)
+		return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+	}
+	float dot3(__m128 a, __m128 b) {
+		float p[4];
+		_mm_storeu_ps(p, _mm_mul_ps(a, b));
+		return p[0] + p[1] + p[2];
+	}
+}
+#endif
+
+Affine::Affine() {
+	rows[0] = glm::vec4(1.0f, 0.0f, 0.0f, 0.0f);
+	rows[1] = glm::vec4(0.0f, 1.0f, 0.0f, 0.0f);
+	rows[2] = glm::vec4(0.0f, 0.0f, 1.0f, 0.0f);
+}
+
+Affine::Affine(glm::vec4 const &row0, glm::vec4 const &row1, glm::vec4 const &row2) {
+	rows[0] = row0;
+	rows[1] = row1;
+	rows[2] = row2;
+}
+
+Affine Affine::trs(glm::vec3 const &position, glm::quat const &rotation, glm::vec3 const &scale) {
+	//same products as glm::mat4_cast:
+	float xx = rotation.x * rotation.x, yy = rotation.y * rotation.y, zz = rotation.z * rotation.z;
+	float xy = rotation.x * rotation.y, xz = rotation.x * rotation.z, yz = rotation.y * rotation.z;
+	float wx = rotation.w * rotation.x, wy = rotation.w * rotation.y, wz = rotation.w * rotation.z;
+
+	//each rotation entry is 1 - 2 * sum on the diagonal and 2 * sum off it, so every row is sums * k + d:
+	Affine ret;
+#ifdef AFFINE_SSE
+	__m128 sums[3] = {
+		_mm_setr_ps(yy + zz, xy - wz, xz + wy, 0.0f),
+		_mm_setr_ps(xy + wz, xx + zz, yz - wx, 0.0f),
+		_mm_setr_ps(xz - wy, yz + wx, xx + yy, 0.0f),
+	};
+	__m128 s = _mm_setr_ps(scale.x, scale.y, scale.z, 0.0f);
+	for (int i = 0; i < 3; ++i) {
+		__m128 k = _mm_setr_ps(i == 0 ? -2.0f : 2.0f, i == 1 ? -2.0f : 2.0f, i == 2 ? -2.0f : 2.0f, 0.0f);
+		__m128 d = _mm_setr_ps(i == 0 ? 1.0f : 0.0f, i == 1 ? 1.0f : 0.0f, i == 2 ? 1.0f : 0.0f, 0.0f);
+		__m128 row = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(sums[i], k), d), s);
+		store(&ret.rows[i], _mm_add_ps(row, _mm_setr_ps(0.0f, 0.0f, 0.0f, position[i])));
+	}
+#else
+	ret.rows[0] = glm::vec4((1.0f - 2.0f * (yy + zz)) * scale.x, 2.0f * (xy - wz) * scale.y, 2.0f * (xz + wy) * scale.z, position.x);
+	ret.rows[1] = glm::vec4(2.0f * (xy + wz) * scale.x, (1.0f - 2.0f * (xx + zz)) * scale.y, 2.0f * (yz - wx) * scale.z, position.y);
+	ret.rows[2] = glm::vec4(2.0f * (xz - wy) * scale.x, 2.0f * (yz + wx) * scale.y, (1.0f - 2.0f * (xx + yy)) * scale.z, position.z);
+#endif
+	return ret;
+}
+
+Affine Affine::inverse_trs(glm::vec3 const &position, glm::quat const &rotation, glm::vec3 const &scale) {
+	glm::vec3 inv_scale;
+	inv_scale.x = (scale.x == 0.0f ? 0.0f : 1.0f / scale.x);
+	inv_scale.y = (scale.y == 0.0f ? 0.0f : 1.0f / scale.y);
+	inv_scale.z = (scale.z == 0.0f ? 0.0f : 1.0f / scale.z);
+
+	//un-scale * un-rotate (scales rows) * un-translate (translation is minus the rows dotted with position):
+	Affine ret = trs(glm::vec3(0.0f), glm::inverse(rotation), glm::vec3(1.0f));
+	for (int i = 0; i < 3; ++i) {
+		glm::vec4 &row = ret.rows[i];
+		row *= inv_scale[i];
+		row.w = -(row.x * position.x + row.y * position.y + row.z * position.z);
+	}
+	return ret;
+}
+
+glm::mat4 Affine::to_mat4() const {
+	return glm::mat4(
+		glm::vec4(rows[0].x, rows[1].x, rows[2].x, 0.0f),
+		glm::vec4(rows[0].y, rows[1].y, rows[2].y, 0.0f),
+		glm::vec4(rows[0].z, rows[1].z, rows[2].z, 0.0f),
+		glm::vec4(rows[0].w, rows[1].w, rows[2].w, 1.0f)
+	);
+}
+
+glm::mat3 Affine::linear() const {
+	return glm::mat3(
+		glm::vec3(rows[0].x, rows[1].x, rows[2].x),
+		glm::vec3(rows[0].y, rows[1].y, rows[2].y),
+		glm::vec3(rows[0].z, rows[1].z, rows[2].z)
+	);
+}
+
+Affine operator*(Affine const &a, Affine const &b) {
+	Affine ret;
+#ifdef AFFINE_SSE
+	__m128 b0 = load(b.rows[0]), b1 = load(b.rows[1]), b2 = load(b.rows[2]);
+	__m128 w = _mm_castsi128_ps(_mm_setr_epi32(0, 0, 0, -1));
+	for (int i = 0; i < 3; ++i) {
+		__m128 ai = load(a.rows[i]);
+		__m128 row = _mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(SPLAT(ai, 0), b0),
+			_mm_mul_ps(SPLAT(ai, 1), b1)),
+			_mm_mul_ps(SPLAT(ai, 2), b2));
+		store(&ret.rows[i], _mm_add_ps(row, _mm_and_ps(ai, w)));
+	}
+#else
+	for (int i = 0; i < 3; ++i) {
+		glm::vec4 const &ai = a.rows[i];
+		ret.rows[i] = ai.x * b.rows[0] + ai.y * b.rows[1] + ai.z * b.rows[2] + glm::vec4(0.0f, 0.0f, 0.0f, ai.w);
+	}
+#endif
+	return ret;
+}
+
+glm::mat4 operator*(glm::mat4 const &a, Affine const &b) {
+	glm::mat4 ret;
+#ifdef AFFINE_SSE
+	__m128 a0 = _mm_loadu_ps(&a[0][0]), a1 = _mm_loadu_ps(&a[1][0]), a2 = _mm_loadu_ps(&a[2][0]), a3 = _mm_loadu_ps(&a[3][0]);
+	//transposing b's rows gives its columns (the fourth row, 0 0 0 1, is implicit):
+	__m128 c0 = load(b.rows[0]), c1 = load(b.rows[1]), c2 = load(b.rows[2]), c3 = _mm_setzero_ps();
+	_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+	__m128 columns[4] = { c0, c1, c2, c3 };
+	for (int j = 0; j < 4; ++j) {
+		__m128 column = _mm_add_ps(_mm_add_ps(
+			_mm_mul_ps(a0, SPLAT(columns[j], 0)),
+			_mm_mul_ps(a1, SPLAT(columns[j], 1))),
+			_mm_mul_ps(a2, SPLAT(columns[j], 2)));
+		if (j == 3) column = _mm_add_ps(column, a3);
+		_mm_storeu_ps(&ret[j][0], column);
+	}
+#else
+	for (int j = 0; j < 4; ++j) {
+		ret[j] = a[0] * b.rows[0][j] + a[1] * b.rows[1][j] + a[2] * b.rows[2][j];
+	}
+	ret[3] += a[3];
+#endif
+	return ret;
+}
+
+glm::vec4 operator*(Affine const &a, glm::vec4 const &v) {
+	return glm::vec4(glm::dot(a.rows[0], v), glm::dot(a.rows[1], v), glm::dot(a.rows[2], v), v.w);
+}
+
+Affine inverse(Affine const &a) {
+	Affine ret;
+#ifdef AFFINE_SSE
+	__m128 r0 = load(a.rows[0]), r1 = load(a.rows[1]), r2 = load(a.rows[2]);
+	//columns of the inverse are the cross products of pairs of rows, over the determinant:
+	__m128 c0 = cross(r1, r2), c1 = cross(r2, r0), c2 = cross(r0, r1);
+	__m128 inv_det = _mm_set1_ps(1.0f / dot3(r0, c0));
+	c0 = _mm_mul_ps(c0, inv_det);
+	c1 = _mm_mul_ps(c1, inv_det);
+	c2 = _mm_mul_ps(c2, inv_det);
+	//new translation is -(inverse linear part * old translation):
+	__m128 t = _mm_sub_ps(_mm_setzero_ps(), _mm_add_ps(_mm_add_ps(
+		_mm_mul_ps(c0, SPLAT(r0, 3)),
+		_mm_mul_ps(c1, SPLAT(r1, 3))),
+		_mm_mul_ps(c2, SPLAT(r2, 3))));
+	_MM_TRANSPOSE4_PS(c0, c1, c2, t);
+	store(&ret.rows[0], c0);
+	store(&ret.rows[1], c1);
+	store(&ret.rows[2], c2);
+#else
+	glm::vec3 r0 = glm::vec3(a.rows[0]), r1 = glm::vec3(a.rows[1]), r2 = glm::vec3(a.rows[2]);
+	float inv_det = 1.0f / glm::dot(r0, glm::cross(r1, r2));
+	glm::vec3 c0 = glm::cross(r1, r2) * inv_det, c1 = glm::cross(r2, r0) * inv_det, c2 = glm::cross(r0, r1) * inv_det;
+	glm::vec3 t = -(c0 * a.rows[0].w + c1 * a.rows[1].w + c2 * a.rows[2].w);
+	ret.rows[0] = glm::vec4(c0.x, c1.x, c2.x, t.x);
+	ret.rows[1] = glm::vec4(c0.y, c1.y, c2.y, t.y);
+	ret.rows[2] = glm::vec4(c0.z, c1.z, c2.z, t.z);
+#endif
+	return ret;
+}
+
+glm::mat3 normal_matrix(Affine const &a, bool uniform_scale) {
+	if (uniform_scale) {
+		//(s R)^-T = R / s = (s R) / s^2, and s^2 is the squared length of any row:
+		glm::vec3 r0 = glm::vec3(a.rows[0]);
+		float inv_scale2 = 1.0f / glm::dot(r0, r0);
+		glm::mat3 ret = a.linear();
+		ret[0] *= inv_scale2;
+		ret[1] *= inv_scale2;
+		ret[2] *= inv_scale2;
+		return ret;
+	}
+	//inverse(transpose(M)) = transpose(inverse(M)), whose rows are the cross products above (so its columns are their x, y, z):
+	glm::vec3 r0 = glm::vec3(a.rows[0]), r1 = glm::vec3(a.rows[1]), r2 = glm::vec3(a.rows[2]);
+	glm::vec3 c0 = glm::cross(r1, r2), c1 = glm::cross(r2, r0), c2 = glm::cross(r0, r1);
+	float inv_det = 1.0f / glm::dot(r0, c0);
+	return glm::mat3(
+		glm::vec3(c0.x, c1.x, c2.x) * inv_det,
+		glm::vec3(c0.y, c1.y, c2.y) * inv_det,
+		glm::vec3(c0.z, c1.z, c2.z) * inv_det
+	);
+}
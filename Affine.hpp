@@ -0,0 +1,34 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+//"Affine" is a 4x4 matrix whose bottom row is known to be (0 0 0 1), stored as the other three rows:
+// rows[i] = (m[0][i], m[1][i], m[2][i], m[3][i]) in glm's column-major m[column][row] terms.
+// At 48 bytes it composes with about half the arithmetic of a glm::mat4 (see Affine.cpp for the SSE kernels).
+struct Affine {
+	glm::vec4 rows[3];
+
+	Affine(); //identity
+	Affine(glm::vec4 const &row0, glm::vec4 const &row1, glm::vec4 const &row2);
+
+	//translate * rotate * scale (same matrix as building the three mat4s and multiplying):
+	static Affine trs(glm::vec3 const &position, glm::quat const &rotation, glm::vec3 const &scale);
+	//the inverse of the above (a zero scale component maps to zero, as in Scene::Transform::make_parent_to_local):
+	static Affine inverse_trs(glm::vec3 const &position, glm::quat const &rotation, glm::vec3 const &scale);
+
+	glm::mat4 to_mat4() const;
+	glm::mat3 linear() const; //upper-left 3x3
+};
+static_assert(sizeof(Affine) == 48, "Affine is packed");
+
+Affine operator*(Affine const &a, Affine const &b);
+glm::mat4 operator*(glm::mat4 const &a, Affine const &b); //(e.g., projection * modelview)
+glm::vec4 operator*(Affine const &a, glm::vec4 const &v);
+
+//general inverse (cofactors of the 3x3 part; a singular matrix gives non-finite results, like glm::inverse):
+Affine inverse(Affine const &a);
+
+//inverse(transpose(linear())) -- the matrix that transforms normals.
+// if 'uniform_scale' (the 3x3 part is a rotation times a single scale factor s) it is just linear() / s^2, and no inverse is needed:
+glm::mat3 normal_matrix(Affine const &a, bool uniform_scale);
@@ -0,0 +1,78 @@
+#include "BufferArena.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <cassert>
+#include <iterator>
+
+BufferArena::BufferArena(size_t unit_, size_t initial_capacity_) : unit(unit_), initial_capacity(initial_capacity_) {
+	assert(unit > 0);
+}
+
+size_t BufferArena::allocate(size_t count) {
+	if (count == 0) return 0;
+
+	for (int attempt = 0; attempt < 2; ++attempt) {
+		for (auto f = free_ranges.begin(); f != free_ranges.end(); ++f) {
+			if (f->second < count) continue;
+			size_t offset = f->first;
+			size_t remain = f->second - count;
+			free_ranges.erase(f);
+			if (remain) free_ranges.insert(std::make_pair(offset + count, remain));
+			return offset;
+		}
+
+		//nothing fits -- grow (at least doubling, so repeated small allocations stay cheap):
+		size_t new_capacity = std::max(std::max(initial_capacity, 2 * capacity), capacity + count);
+		GLuint new_buffer = 0;
+		glGenBuffers(1, &new_buffer);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, new_buffer);
+		glBufferData(GL_COPY_WRITE_BUFFER, new_capacity * unit, nullptr, GL_STATIC_DRAW);
+		if (buffer) {
+			glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, capacity * unit);
+			glDeleteBuffers(1, &buffer);
+		}
+		buffer = new_buffer;
+		size_t old_capacity = capacity;
+		capacity = new_capacity;
+		free(old_capacity, new_capacity - old_capacity);
+	}
+	throw std::runtime_error("BufferArena failed to allocate after growing");
+}
+
+void BufferArena::free(size_t offset, size_t count) {
+	if (count == 0) return;
+	assert(offset + count <= capacity);
+
+	auto next = free_ranges.lower_bound(offset);
+	assert(next == free_ranges.end() || offset + count <= next->first);
+	//merge with following range:
+	if (next != free_ranges.end() && next->first == offset + count) {
+		count += next->second;
+		next = free_ranges.erase(next);
+	}
+	//merge with preceding range:
+	if (next != free_ranges.begin()) {
+		auto prev = std::prev(next);
+		assert(prev->first + prev->second <= offset);
+		if (prev->first + prev->second == offset) {
+			prev->second += count;
+			return;
+		}
+	}
+	free_ranges.insert(next, std::make_pair(offset, count));
+}
+
+void BufferArena::upload(size_t byte_offset, void const *data, size_t size) {
+	assert(byte_offset + size <= capacity * unit);
+	if (size == 0) return;
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, byte_offset, size, data);
+}
+
+size_t BufferArena::used() const {
+	size_t unused = 0;
+	for (auto const &f : free_ranges) unused += f.second;
+	return capacity - unused;
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include "GL.hpp"
+#include <map>
+#include <cstddef>
+
+//"BufferArena" sub-allocates ranges of one large GL buffer, growing it (and copying its contents) when full:
+// ranges are counted in 'unit'-byte units (e.g., one vertex) so that offsets work directly as vertex starts.
+// note: 'buffer' changes when the arena grows, so anything pointing at it (e.g. a VAO) must be re-pointed.
+struct BufferArena {
+	BufferArena(size_t unit, size_t initial_capacity);
+	BufferArena(BufferArena const &) = delete;
+	BufferArena &operator=(BufferArena const &) = delete;
+
+	size_t const unit; //bytes per unit
+	size_t const initial_capacity; //units allocated on first use
+	GLuint buffer = 0; //(created on first allocate; lives as long as the GL context)
+	size_t capacity = 0; //units
+	std::map< size_t, size_t > free_ranges; //offset -> count (adjacent free ranges are always merged)
+
+	//reserve 'count' units (first fit, growing the buffer if nothing fits); returns the offset of the first:
+	size_t allocate(size_t count);
+
+	//return a range to the free list (for reuse by later allocations):
+	void free(size_t offset, size_t count);
+
+	//write 'size' bytes of data starting 'byte_offset' bytes into the buffer:
+	// (binds GL_COPY_WRITE_BUFFER, so no VAO or GL_ARRAY_BUFFER binding is disturbed)
+	void upload(size_t byte_offset, void const *data, size_t size);
+
+	//units not on the free list:
+	size_t used() const;
+};
@@ -0,0 +1,109 @@
+#include "ChunkFile.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include <cstring>
+
+ChunkFile::ChunkFile(std::string const &filename_) : filename(filename_) {
+	#ifdef _WIN32
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("Failed to open chunk file '" + filename + "'");
+	}
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size)) {
+		CloseHandle(file);
+		throw std::runtime_error("Failed to get size of chunk file '" + filename + "'");
+	}
+	length = size_t(file_size.QuadPart);
+	file_handle = file;
+	if (length != 0) {
+		HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping == NULL) {
+			CloseHandle(file);
+			throw std::runtime_error("Failed to map chunk file '" + filename + "'");
+		}
+		mapping_handle = mapping;
+		base = reinterpret_cast< char const * >(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		if (base == nullptr) {
+			CloseHandle(mapping);
+			CloseHandle(file);
+			throw std::runtime_error("Failed to map chunk file '" + filename + "'");
+		}
+	}
+	#else
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) {
+		throw std::runtime_error("Failed to open chunk file '" + filename + "'");
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0) {
+		close(fd);
+		throw std::runtime_error("Failed to get size of chunk file '" + filename + "'");
+	}
+	length = size_t(st.st_size);
+	if (length != 0) {
+		void *mapped = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (mapped == MAP_FAILED) {
+			close(fd);
+			throw std::runtime_error("Failed to map chunk file '" + filename + "'");
+		}
+		//chunks are consumed front-to-back, so let the kernel read ahead:
+		madvise(mapped, length, MADV_SEQUENTIAL);
+		base = reinterpret_cast< char const * >(mapped);
+	}
+	close(fd); //mapping stays valid after the descriptor is closed
+	#endif
+}
+
+ChunkFile::~ChunkFile() {
+	#ifdef _WIN32
+	if (base) UnmapViewOfFile(base);
+	if (mapping_handle) CloseHandle(mapping_handle);
+	if (file_handle) CloseHandle(file_handle);
+	#else
+	if (base) munmap(const_cast< char * >(base), length);
+	#endif
+}
+
+std::string ChunkFile::peek_magic() const {
+	if (length - offset < 4) return "";
+	return std::string(base + offset, 4);
+}
+
+char const *ChunkFile::read_raw(size_t *_at, std::string const &magic, uint32_t *size) {
+	assert(_at);
+	assert(size);
+	size_t &at = *_at;
+
+	struct ChunkHeader {
+		char magic[4] = {'\0', '\0', '\0', '\0'};
+		uint32_t size = 0;
+	};
+	static_assert(sizeof(ChunkHeader) == 8, "header is packed");
+
+	if (!(at <= length && length - at >= sizeof(ChunkHeader))) {
+		throw std::runtime_error("Failed to read chunk header");
+	}
+	ChunkHeader header;
+	std::memcpy(&header, base + at, sizeof(header));
+	if (std::string(header.magic,4) != magic) {
+		throw std::runtime_error("Unexpected magic number in chunk");
+	}
+	if (length - at - sizeof(ChunkHeader) < header.size) {
+		throw std::runtime_error("Failed to read chunk data.");
+	}
+
+	char const *data = base + at + sizeof(ChunkHeader);
+	at += sizeof(ChunkHeader) + header.size;
+	*size = header.size;
+	return data;
+}
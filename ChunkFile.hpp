@@ -0,0 +1,114 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <list>
+#include <stdexcept>
+#include <cassert>
+#include <cstddef>
+#include <stdint.h>
+
+//ChunkView is a typed, read-only window onto the contents of a chunk:
+// (the pointed-to data is owned by the ChunkFile that produced the view)
+template< typename T >
+struct ChunkView {
+	T const *data = nullptr;
+	size_t size = 0;
+
+	T const &operator[](size_t i) const {
+		assert(i < size);
+		return data[i];
+	}
+	T const *begin() const { return data; }
+	T const *end() const { return data + size; }
+	bool empty() const { return size == 0; }
+};
+
+//"ChunkFile" memory-maps a chunked blob once and hands out in-place views of its chunks.
+// chunks are [magic:4][size:uint32][data:size] as written by models/export-meshes.py
+struct ChunkFile {
+	//map the file; will throw if the file can't be opened or mapped.
+	ChunkFile(std::string const &filename);
+	ChunkFile(ChunkFile const &) = delete;
+	ChunkFile &operator=(ChunkFile const &) = delete;
+	~ChunkFile();
+
+	//read the next chunk, which must have the given magic number:
+	// note: will throw if the chunk is truncated, mislabeled, or not a whole number of T's.
+	template< typename T >
+	ChunkView< T > read(std::string const &magic);
+
+	//read the chunk whose header starts at byte 'at' (e.g., from a toc0 entry) without moving the cursor:
+	template< typename T >
+	ChunkView< T > read_at(size_t at, std::string const &magic);
+
+	//view an arbitrary byte range of the file (e.g., one mesh's vertices within a data chunk):
+	template< typename T >
+	ChunkView< T > view(size_t at, size_t size);
+
+	//magic number of the next chunk (or "" at the end of the file):
+	std::string peek_magic() const;
+
+	//true once every chunk in the file has been read:
+	bool at_end() const { return offset == length; }
+
+	//internals:
+	std::string filename;
+	char const *base = nullptr; //start of the mapping
+	size_t length = 0; //bytes in the mapping
+	size_t offset = 0; //read cursor (start of the next chunk header)
+	#ifdef _WIN32
+	void *file_handle = nullptr;
+	void *mapping_handle = nullptr;
+	#endif
+
+	//chunk data that isn't suitably aligned for its element type is copied here:
+	std::list< std::vector< char > > realigned;
+
+	//returns the data of the chunk at 'at' (checking magic + bounds) and advances 'at' past it:
+	char const *read_raw(size_t *at, std::string const &magic, uint32_t *size);
+
+	//checks element size + alignment of some in-file data and wraps it in a view:
+	template< typename T >
+	ChunkView< T > make_view(char const *data, size_t size);
+};
+
+template< typename T >
+ChunkView< T > ChunkFile::read(std::string const &magic) {
+	uint32_t size = 0;
+	char const *data = read_raw(&offset, magic, &size);
+	return make_view< T >(data, size);
+}
+
+template< typename T >
+ChunkView< T > ChunkFile::read_at(size_t at, std::string const &magic) {
+	uint32_t size = 0;
+	char const *data = read_raw(&at, magic, &size);
+	return make_view< T >(data, size);
+}
+
+template< typename T >
+ChunkView< T > ChunkFile::view(size_t at, size_t size) {
+	if (!(at <= length && size <= length - at)) {
+		throw std::runtime_error("Byte range is outside of chunk file '" + filename + "'");
+	}
+	return make_view< T >(base + at, size);
+}
+
+template< typename T >
+ChunkView< T > ChunkFile::make_view(char const *data, size_t size) {
+	if (size % sizeof(T) != 0) {
+		throw std::runtime_error("Size of chunk not divisible by element size");
+	}
+
+	if (reinterpret_cast< uintptr_t >(data) % alignof(T) != 0) {
+		//chunks are only padded to their own length, so e.g. an odd-length str0 chunk misaligns what follows:
+		realigned.emplace_back(data, data + size);
+		data = realigned.back().data();
+	}
+
+	ChunkView< T > view;
+	view.data = reinterpret_cast< T const * >(data);
+	view.size = size / sizeof(T);
+	return view;
+}
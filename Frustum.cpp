@@ -0,0 +1,104 @@
+#include "Frustum.hpp"
+
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRUSTUM_SSE
+#include <emmintrin.h>
+#endif
+
+Frustum Frustum::from_world_to_clip(glm::mat4 const &m) {
+	//rows of m (glm is column-major):
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; ++i) {
+		rows[i] = glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]);
+	}
+	//each clip plane is w +/- x, y, or z (left, right, bottom, top, near, far):
+	glm::vec4 candidates[6] = {
+		rows[3] + rows[0], rows[3] - rows[0],
+		rows[3] + rows[1], rows[3] - rows[1],
+		rows[3] + rows[2], rows[3] - rows[2],
+	};
+
+	Frustum frustum;
+	for (glm::vec4 const &plane : candidates) {
+		float length = glm::length(glm::vec3(plane));
+		//an infinite far plane comes out as (0, 0, 0, positive) -- every point is inside it:
+		if (length < 1e-6f * std::abs(plane.w) || length == 0.0f) continue;
+		frustum.planes[frustum.count++] = plane / length;
+	}
+	return frustum;
+}
+
+void SphereArrays::push_back(glm::vec3 const &center, float r) {
+	if (size == x.size()) {
+		size_t capacity = (size + 4) & ~size_t(3);
+		x.resize(capacity, 0.0f);
+		y.resize(capacity, 0.0f);
+		z.resize(capacity, 0.0f);
+		radius.resize(capacity, 0.0f);
+	}
+	x[size] = center.x;
+	y[size] = center.y;
+	z[size] = center.z;
+	radius[size] = r;
+	size += 1;
+}
+
+void SphereArrays::resize(size_t count) {
+	size_t capacity = (count + 3) & ~size_t(3);
+	x.resize(capacity, 0.0f);
+	y.resize(capacity, 0.0f);
+	z.resize(capacity, 0.0f);
+	radius.resize(capacity, 0.0f);
+	size = count;
+}
+
+size_t cull_spheres(Frustum const &frustum, SphereArrays const &spheres, uint8_t *visible) {
+	return cull_spheres(frustum, spheres, 0, spheres.size, visible);
+}
+
+size_t cull_spheres(Frustum const &frustum, SphereArrays const &spheres, size_t begin, size_t end, uint8_t *visible) {
+	size_t total = 0;
+#ifdef FRUSTUM_SSE
+	__m128 px[6], py[6], pz[6], pw[6];
+	for (uint32_t p = 0; p < frustum.count; ++p) {
+		px[p] = _mm_set1_ps(frustum.planes[p].x);
+		py[p] = _mm_set1_ps(frustum.planes[p].y);
+		pz[p] = _mm_set1_ps(frustum.planes[p].z);
+		pw[p] = _mm_set1_ps(frustum.planes[p].w);
+	}
+	//four spheres per iteration (the arrays are padded, so loads never run past the end):
+	for (size_t i = begin; i < end; i += 4) {
+		__m128 x = _mm_loadu_ps(&spheres.x[i]);
+		__m128 y = _mm_loadu_ps(&spheres.y[i]);
+		__m128 z = _mm_loadu_ps(&spheres.z[i]);
+		__m128 neg_r = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&spheres.radius[i]));
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (uint32_t p = 0; p < frustum.count; ++p) {
+			__m128 distance = _mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(x, px[p]),
+				_mm_mul_ps(y, py[p])),
+				_mm_add_ps(_mm_mul_ps(z, pz[p]), pw[p]));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, neg_r));
+		}
+		int mask = _mm_movemask_ps(inside);
+		for (size_t j = 0; j < 4 && i + j < end; ++j) {
+			visible[i + j] = uint8_t((mask >> j) & 1);
+			total += visible[i + j];
+		}
+	}
+#else
+	for (size_t i = begin; i < end; ++i) {
+		bool inside = true;
+		for (uint32_t p = 0; p < frustum.count; ++p) {
+			glm::vec4 const &plane = frustum.planes[p];
+			float distance = plane.x * spheres.x[i] + plane.y * spheres.y[i] + plane.z * spheres.z[i] + plane.w;
+			inside = inside && (distance >= -spheres.radius[i]);
+		}
+		visible[i] = uint8_t(inside);
+		total += visible[i];
+	}
+#endif
+	return total;
+}
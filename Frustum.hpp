@@ -0,0 +1,36 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <cstddef>
+#include <stdint.h>
+
+//"Frustum" is the set of (normalized) planes bounding a view volume; a point p is inside when
+// dot(plane.xyz, p) + plane.w >= 0 for every plane.
+struct Frustum {
+	glm::vec4 planes[6];
+	uint32_t count = 0;
+
+	//extract the planes of clip space (-w <= x, y, z <= w) from a world-to-clip matrix:
+	// planes that degenerate -- like the far plane of glm::infinitePerspective, which is at infinity -- are dropped.
+	static Frustum from_world_to_clip(glm::mat4 const &world_to_clip);
+};
+
+//Bounding spheres stored as separate arrays (so four can be tested at once):
+// arrays are padded to a multiple of four entries, and the padding is never reported visible.
+struct SphereArrays {
+	std::vector< float > x, y, z, radius;
+	size_t size = 0;
+
+	void clear() { size = 0; }
+	void push_back(glm::vec3 const &center, float r);
+	//set the size (new entries are zero), so entries can be filled in by index -- e.g., from several threads:
+	void resize(size_t count);
+};
+
+//set visible[i] to 1 if sphere i touches the frustum, 0 otherwise (using SSE where available):
+// 'visible' must have room for spheres.size entries; returns the number visible.
+size_t cull_spheres(Frustum const &frustum, SphereArrays const &spheres, uint8_t *visible);
+//the same, for spheres [begin, end) only ('begin' must be a multiple of four):
+size_t cull_spheres(Frustum const &frustum, SphereArrays const &spheres, size_t begin, size_t end, uint8_t *visible);
@@ -0,0 +1,314 @@
+#include "MeshBlob.hpp"
+#include "ChunkFile.hpp"
+#include "PerfectHash.hpp"
+
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <cstring>
+#include <utility>
+
+using namespace MeshChunks;
+
+void MeshBlob::load(std::string const &filename) {
+	ChunkFile file(filename);
+	meshes.clear();
+
+	if (file.peek_magic() == "toc0") {
+		file.read< char >("toc0"); //rebuilt on save
+	}
+
+	compact = (file.peek_magic() == "q3n2");
+	ChunkView< char > data = file.read< char >(compact ? "q3n2" : "v3n3");
+	if (data.size % vertex_size() != 0) {
+		throw std::runtime_error("Size of vertex chunk not divisible by vertex size");
+	}
+	uint32_t total = uint32_t(data.size / vertex_size());
+
+	ChunkView< char > strings = file.read< char >("str0");
+
+	auto add_mesh = [&](uint32_t name_begin, uint32_t name_end, uint32_t vertex_start, uint32_t vertex_count) -> Mesh & {
+		if (!(name_begin <= name_end && name_end <= strings.size)) {
+			throw std::runtime_error("index entry has out-of-range name begin/end");
+		}
+		if (!(vertex_start <= vertex_start + vertex_count && vertex_start + vertex_count <= total)) {
+			throw std::runtime_error("index entry has out-of-range vertex start/count");
+		}
+		meshes.emplace_back();
+		Mesh &mesh = meshes.back();
+		mesh.name = std::string(strings.data + name_begin, strings.data + name_end);
+		mesh.vertices.assign(data.data + vertex_start * vertex_size(), data.data + (vertex_start + vertex_count) * vertex_size());
+		return mesh;
+	};
+
+	if (compact) {
+		for (auto const &entry : file.read< CompactIndexEntry >("idq0")) {
+			Mesh &mesh = add_mesh(entry.name_begin, entry.name_end, entry.vertex_start, entry.vertex_count);
+			mesh.min = entry.min;
+			mesh.max = entry.max;
+		}
+	} else {
+		for (auto const &entry : file.read< IndexEntry >("idx0")) {
+			add_mesh(entry.name_begin, entry.name_end, entry.vertex_start, entry.vertex_count);
+		}
+	}
+
+	if (file.peek_magic() == "ind0") {
+		ChunkView< char > index_data = file.read< char >("ind0");
+		ChunkView< ElementEntry > elements = file.read< ElementEntry >("elm0");
+		if (elements.size != meshes.size()) {
+			throw std::runtime_error("elm0 chunk doesn't have one entry per mesh");
+		}
+		for (uint32_t m = 0; m < meshes.size(); ++m) {
+			ElementEntry const &entry = elements[m];
+			Mesh &mesh = meshes[m];
+			if (!((entry.index_size == 2 || entry.index_size == 4)
+				&& entry.index_start <= index_data.size
+				&& uint64_t(entry.index_count) * entry.index_size <= index_data.size - entry.index_start)) {
+				throw std::runtime_error("element entry has out-of-range index start/count/size");
+			}
+			mesh.indexed = true;
+			mesh.indices.resize(entry.index_count);
+			char const *at = index_data.data + entry.index_start;
+			for (uint32_t i = 0; i < entry.index_count; ++i) {
+				if (entry.index_size == 2) {
+					uint16_t index;
+					std::memcpy(&index, at + 2 * i, 2);
+					mesh.indices[i] = index;
+				} else {
+					std::memcpy(&mesh.indices[i], at + 4 * i, 4);
+				}
+				if (mesh.indices[i] >= mesh.vertex_count(*this)) {
+					throw std::runtime_error("index out of range in mesh '" + mesh.name + "'");
+				}
+			}
+		}
+	}
+
+	if (file.peek_magic() == "bnd0") {
+		file.read< MeshBounds >("bnd0"); //recomputed on save
+	}
+
+	if (file.peek_magic() == "phf0") {
+		file.read< uint32_t >("phf0"); //rebuilt on save
+	}
+
+	if (!file.at_end()) {
+		throw std::runtime_error("trailing data in mesh file '" + filename + "'");
+	}
+}
+
+glm::vec3 MeshBlob::Mesh::position(MeshBlob const &blob, uint32_t vertex) const {
+	assert(vertex < vertex_count(blob));
+	if (blob.compact) {
+		q3n2c4 v;
+		std::memcpy(&v, vertices.data() + vertex * sizeof(q3n2c4), sizeof(q3n2c4));
+		return min + (max - min) * (glm::vec3(v.v[0], v.v[1], v.v[2]) / 65535.0f);
+	} else {
+		v3n3c3 v;
+		std::memcpy(&v, vertices.data() + vertex * sizeof(v3n3c3), sizeof(v3n3c3));
+		return v.v;
+	}
+}
+
+MeshBounds MeshBlob::Mesh::bounds(MeshBlob const &blob) const {
+	if (!blob.compact) {
+		return compute_bounds(vertices.data(), sizeof(v3n3c3), vertex_count(blob));
+	}
+	std::vector< glm::vec3 > positions;
+	positions.reserve(vertex_count(blob));
+	for (uint32_t v = 0; v < vertex_count(blob); ++v) {
+		positions.emplace_back(position(blob, v));
+	}
+	return compute_bounds(positions.data(), sizeof(glm::vec3), positions.size());
+}
+
+namespace {
+	template< typename T >
+	void append(std::vector< char > *to, T const &value) {
+		char const *bytes = reinterpret_cast< char const * >(&value);
+		to->insert(to->end(), bytes, bytes + sizeof(T));
+	}
+}
+
+void MeshBlob::save(std::string const &filename) const {
+	std::vector< char > data, strings, index, index_data, elements, bounds;
+	std::vector< TocMesh > toc_meshes;
+
+	bool any_indexed = false;
+	for (auto const &mesh : meshes) {
+		any_indexed = any_indexed || mesh.indexed;
+	}
+
+	uint32_t vertex_start = 0;
+	for (auto const &mesh : meshes) {
+		uint32_t name_begin = uint32_t(strings.size());
+		strings.insert(strings.end(), mesh.name.begin(), mesh.name.end());
+		uint32_t name_end = uint32_t(strings.size());
+		uint32_t vertex_count = mesh.vertex_count(*this);
+
+		if (compact) {
+			CompactIndexEntry entry;
+			entry.name_begin = name_begin;
+			entry.name_end = name_end;
+			entry.vertex_start = vertex_start;
+			entry.vertex_count = vertex_count;
+			entry.min = mesh.min;
+			entry.max = mesh.max;
+			append(&index, entry);
+		} else {
+			IndexEntry entry;
+			entry.name_begin = name_begin;
+			entry.name_end = name_end;
+			entry.vertex_start = vertex_start;
+			entry.vertex_count = vertex_count;
+			append(&index, entry);
+		}
+
+		TocMesh toc_mesh;
+		toc_mesh.name_begin = name_begin;
+		toc_mesh.name_end = name_end;
+		toc_mesh.vertex_start = vertex_start;
+		toc_mesh.vertex_count = vertex_count;
+		toc_mesh.offset = uint32_t(data.size()); //(made absolute once chunk offsets are known)
+		toc_mesh.size = uint32_t(mesh.vertices.size());
+		toc_meshes.emplace_back(toc_mesh);
+
+		data.insert(data.end(), mesh.vertices.begin(), mesh.vertices.end());
+		vertex_start += vertex_count;
+
+		append(&bounds, mesh.bounds(*this));
+
+		if (any_indexed) {
+			//non-indexed meshes get an identity index list so every mesh draws the same way:
+			std::vector< uint32_t > identity;
+			std::vector< uint32_t > const *indices = &mesh.indices;
+			if (!mesh.indexed) {
+				identity.reserve(vertex_count);
+				for (uint32_t i = 0; i < vertex_count; ++i) identity.emplace_back(i);
+				indices = &identity;
+			}
+			ElementEntry entry;
+			entry.index_start = uint32_t(index_data.size());
+			entry.index_count = uint32_t(indices->size());
+			entry.index_size = (vertex_count <= 0x10000 ? 2 : 4);
+			for (uint32_t i : *indices) {
+				if (entry.index_size == 2) append(&index_data, uint16_t(i));
+				else append(&index_data, i);
+			}
+			while (index_data.size() % 4) index_data.emplace_back('\0');
+			append(&elements, entry);
+		}
+	}
+
+	//name lookup table, so the game doesn't need to build one:
+	std::vector< char > name_hash;
+	{
+		std::vector< std::string > names;
+		names.reserve(meshes.size());
+		for (auto const &mesh : meshes) names.emplace_back(mesh.name);
+		PerfectHash hash;
+		hash.build(names);
+		std::vector< uint32_t > words = hash.to_chunk();
+		name_hash.assign(reinterpret_cast< char const * >(words.data()), reinterpret_cast< char const * >(words.data() + words.size()));
+	}
+
+	std::vector< std::pair< std::string, std::vector< char > const * > > chunks;
+	chunks.emplace_back(compact ? "q3n2" : "v3n3", &data);
+	chunks.emplace_back("str0", &strings);
+	chunks.emplace_back(compact ? "idq0" : "idx0", &index);
+	if (any_indexed) {
+		chunks.emplace_back("ind0", &index_data);
+		chunks.emplace_back("elm0", &elements);
+	}
+	chunks.emplace_back("bnd0", &bounds);
+	chunks.emplace_back("phf0", &name_hash);
+
+	//table of contents (see models/export-meshes.py):
+	std::vector< char > toc;
+	TocHeader header;
+	header.chunk_count = uint32_t(chunks.size());
+	header.mesh_count = uint32_t(toc_meshes.size());
+	append(&toc, header);
+	uint64_t offset = 8 + sizeof(TocHeader) + chunks.size() * sizeof(TocChunk) + toc_meshes.size() * sizeof(TocMesh);
+	uint64_t data_offset = 0;
+	for (auto const &chunk : chunks) {
+		TocChunk entry;
+		std::memcpy(entry.magic, chunk.first.c_str(), 4);
+		entry.offset = uint32_t(offset);
+		entry.size = uint32_t(chunk.second->size());
+		append(&toc, entry);
+		if (chunk.second == &data) data_offset = offset + 8;
+		offset += 8 + chunk.second->size();
+	}
+	if (offset > 0xffffffffULL) {
+		throw std::runtime_error("mesh blob '" + filename + "' would be larger than 4GB");
+	}
+	for (auto toc_mesh : toc_meshes) {
+		toc_mesh.offset += uint32_t(data_offset);
+		append(&toc, toc_mesh);
+	}
+
+	std::ofstream file(filename, std::ios::binary);
+	auto write_chunk = [&](std::string const &magic, std::vector< char > const &payload) {
+		uint32_t size = uint32_t(payload.size());
+		file.write(magic.c_str(), 4);
+		file.write(reinterpret_cast< char const * >(&size), 4);
+		file.write(payload.data(), payload.size());
+	};
+	write_chunk("toc0", toc);
+	for (auto const &chunk : chunks) {
+		write_chunk(chunk.first, *chunk.second);
+	}
+	if (!file) {
+		throw std::runtime_error("Failed to write mesh blob '" + filename + "'");
+	}
+}
+
+uint32_t weld_vertices(MeshBlob const &blob, MeshBlob::Mesh *_mesh) {
+	assert(_mesh);
+	auto &mesh = *_mesh;
+	uint32_t vertex_size = blob.vertex_size();
+	uint32_t vertex_count = mesh.vertex_count(blob);
+
+	//hash vertices by their bytes (so -0.0 and 0.0, or differing normals, stay distinct -- welding is lossless):
+	struct VertexKey {
+		char const *bytes;
+		uint32_t size;
+		bool operator==(VertexKey const &o) const { return std::memcmp(bytes, o.bytes, size) == 0; }
+	};
+	struct VertexHash {
+		size_t operator()(VertexKey const &key) const {
+			uint64_t h = 14695981039346656037ULL; //FNV-1a
+			for (uint32_t i = 0; i < key.size; ++i) {
+				h = (h ^ uint8_t(key.bytes[i])) * 1099511628211ULL;
+			}
+			return size_t(h);
+		}
+	};
+	std::unordered_map< VertexKey, uint32_t, VertexHash > first;
+	first.reserve(vertex_count);
+
+	std::vector< char > vertices;
+	std::vector< uint32_t > remap(vertex_count);
+	for (uint32_t v = 0; v < vertex_count; ++v) {
+		VertexKey key;
+		key.bytes = mesh.vertices.data() + v * vertex_size;
+		key.size = vertex_size;
+		auto ret = first.insert(std::make_pair(key, uint32_t(vertices.size() / vertex_size)));
+		if (ret.second) {
+			vertices.insert(vertices.end(), key.bytes, key.bytes + vertex_size);
+		}
+		remap[v] = ret.first->second;
+	}
+
+	if (mesh.indexed) {
+		for (auto &i : mesh.indices) i = remap[i];
+	} else {
+		mesh.indices = remap;
+		mesh.indexed = true;
+	}
+	uint32_t removed = vertex_count - uint32_t(vertices.size() / vertex_size);
+	mesh.vertices.swap(vertices); //(keys point into the old vertices, so swap only at the end)
+	return removed;
+}
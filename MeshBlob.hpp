@@ -0,0 +1,108 @@
+#pragma once
+
+#include "MeshBounds.hpp"
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+//On-disk layout of meshes.blob (written by models/export-meshes.py and the C++ tools):
+//  [toc0] (optional) directory of chunks + per-mesh vertex ranges
+//  v3n3 | q3n2       vertex data (MeshChunks::v3n3c3 or MeshChunks::q3n2c4)
+//  str0              mesh names
+//  idx0 | idq0       per-mesh name + vertex range (idq0 adds the quantization box)
+//  [ind0 + elm0]     (optional) index data + per-mesh index ranges
+//  [bnd0]            (optional) per-mesh MeshBounds (box + sphere), parallel to idx0/idq0
+//  [phf0]            (optional) perfect hash of mesh names -> idx0/idq0 entry (see PerfectHash.hpp)
+namespace MeshChunks {
+	struct v3n3c3 {
+		glm::vec3 v;
+		glm::vec3 n;
+		glm::vec3 c;
+	};
+	static_assert(sizeof(v3n3c3) == 36, "v3n3c3 is packed");
+
+	//compact vertex: position as unorm16 within the mesh's bounding box, octahedral snorm16 normal, rgba8 color:
+	struct q3n2c4 {
+		uint16_t v[3];
+		uint16_t pad;
+		int16_t n[2];
+		uint8_t c[4];
+	};
+	static_assert(sizeof(q3n2c4) == 16, "q3n2c4 is packed");
+
+	struct IndexEntry {
+		uint32_t name_begin, name_end;
+		uint32_t vertex_start, vertex_count;
+	};
+	static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
+
+	//compact meshes also carry the bounding box their positions are quantized against:
+	struct CompactIndexEntry {
+		uint32_t name_begin, name_end;
+		uint32_t vertex_start, vertex_count;
+		glm::vec3 min, max;
+	};
+	static_assert(sizeof(CompactIndexEntry) == 40, "Compact index entry should be packed");
+
+	//elm0 entries parallel idx0/idq0 entries; indices are relative to the mesh's vertex_start:
+	struct ElementEntry {
+		uint32_t index_start; //byte offset into ind0 (always 4-byte aligned)
+		uint32_t index_count;
+		uint32_t index_size; //2 or 4 bytes
+	};
+	static_assert(sizeof(ElementEntry) == 12, "Element entry should be packed");
+
+	//the optional "toc0" chunk at the head of a blob lists where everything else is:
+	struct TocHeader {
+		uint32_t chunk_count, mesh_count;
+	};
+	static_assert(sizeof(TocHeader) == 8, "TOC header should be packed");
+	struct TocChunk {
+		char magic[4];
+		uint32_t offset; //file offset of the chunk's header
+		uint32_t size; //size of the chunk's data
+	};
+	static_assert(sizeof(TocChunk) == 12, "TOC chunk entry should be packed");
+	struct TocMesh {
+		uint32_t name_begin, name_end; //into str0
+		uint32_t vertex_start, vertex_count; //as in idx0
+		uint32_t offset, size; //file offset + size of the mesh's vertex data
+	};
+	static_assert(sizeof(TocMesh) == 24, "TOC mesh entry should be packed");
+}
+
+//"MeshBlob" is an editable, CPU-side copy of a meshes.blob, used by the offline tools:
+struct MeshBlob {
+	bool compact = false; //q3n2c4 vertices (otherwise v3n3c3)
+	uint32_t vertex_size() const { return compact ? sizeof(MeshChunks::q3n2c4) : sizeof(MeshChunks::v3n3c3); }
+
+	struct Mesh {
+		std::string name;
+		std::vector< char > vertices; //vertex_size() bytes per vertex
+		bool indexed = false;
+		std::vector< uint32_t > indices; //(if indexed) relative to this mesh's first vertex
+		glm::vec3 min = glm::vec3(0.0f), max = glm::vec3(0.0f); //(if compact) quantization box
+
+		uint32_t vertex_count(MeshBlob const &blob) const { return uint32_t(vertices.size() / blob.vertex_size()); }
+		//(decoded) object-space position of a vertex:
+		glm::vec3 position(MeshBlob const &blob, uint32_t vertex) const;
+		//bounding volumes of the (decoded) positions:
+		MeshBounds bounds(MeshBlob const &blob) const;
+	};
+	std::vector< Mesh > meshes;
+
+	//read a blob in any of the formats Meshes::load understands:
+	// note: will throw if file fails to read.
+	void load(std::string const &filename);
+
+	//write a blob (with toc0, bnd0 and phf0; with ind0/elm0 if any mesh is indexed):
+	// note: will throw if file fails to write.
+	void save(std::string const &filename) const;
+};
+
+//merge bitwise-identical vertices of a triangle-soup (or already indexed) mesh, producing an index list:
+// returns the number of vertices removed.
+uint32_t weld_vertices(MeshBlob const &blob, MeshBlob::Mesh *mesh);
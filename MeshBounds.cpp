@@ -0,0 +1,99 @@
+#include "MeshBounds.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MESH_BOUNDS_SSE
+#include <emmintrin.h>
+#endif
+
+namespace {
+	glm::vec3 position_at(char const *vertices, size_t stride, size_t i) {
+		glm::vec3 position;
+		std::memcpy(&position, vertices + i * stride, sizeof(glm::vec3));
+		return position;
+	}
+}
+
+MeshBounds compute_bounds(void const *_vertices, size_t stride, size_t count) {
+	MeshBounds bounds;
+	if (count == 0) return bounds;
+	char const *vertices = reinterpret_cast< char const * >(_vertices);
+
+	//the last vertex is handled on its own -- the SSE loops read 16 bytes per position, which may run past the end:
+	glm::vec3 last = position_at(vertices, stride, count - 1);
+	bounds.min = bounds.max = last;
+
+#ifdef MESH_BOUNDS_SSE
+	{ //min/max pass (two vertices per iteration, in separate accumulators):
+		__m128 lo0 = _mm_setr_ps(last.x, last.y, last.z, 0.0f);
+		__m128 hi0 = lo0, lo1 = lo0, hi1 = lo0;
+		size_t i = 0;
+		for (; i + 2 < count; i += 2) {
+			__m128 a = _mm_loadu_ps(reinterpret_cast< float const * >(vertices + i * stride));
+			__m128 b = _mm_loadu_ps(reinterpret_cast< float const * >(vertices + (i + 1) * stride));
+			lo0 = _mm_min_ps(lo0, a);
+			hi0 = _mm_max_ps(hi0, a);
+			lo1 = _mm_min_ps(lo1, b);
+			hi1 = _mm_max_ps(hi1, b);
+		}
+		for (; i + 1 < count; ++i) {
+			__m128 a = _mm_loadu_ps(reinterpret_cast< float const * >(vertices + i * stride));
+			lo0 = _mm_min_ps(lo0, a);
+			hi0 = _mm_max_ps(hi0, a);
+		}
+		float lo[4], hi[4];
+		_mm_storeu_ps(lo, _mm_min_ps(lo0, lo1));
+		_mm_storeu_ps(hi, _mm_max_ps(hi0, hi1));
+		bounds.min = glm::vec3(lo[0], lo[1], lo[2]);
+		bounds.max = glm::vec3(hi[0], hi[1], hi[2]);
+	}
+#else
+	for (size_t i = 0; i + 1 < count; ++i) {
+		glm::vec3 p = position_at(vertices, stride, i);
+		bounds.min = glm::min(bounds.min, p);
+		bounds.max = glm::max(bounds.max, p);
+	}
+#endif
+
+	bounds.center = 0.5f * (bounds.min + bounds.max);
+
+	//radius pass (squared distances from the center):
+	glm::vec3 d = last - bounds.center;
+	float farthest = glm::dot(d, d);
+#ifdef MESH_BOUNDS_SSE
+	{
+		__m128 center = _mm_setr_ps(bounds.center.x, bounds.center.y, bounds.center.z, 0.0f);
+		__m128 xyz = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+		__m128 best = _mm_set_ss(farthest);
+		for (size_t i = 0; i + 1 < count; ++i) {
+			__m128 p = _mm_loadu_ps(reinterpret_cast< float const * >(vertices + i * stride));
+			__m128 v = _mm_and_ps(_mm_sub_ps(p, center), xyz);
+			__m128 sq = _mm_mul_ps(v, v);
+			__m128 sum = _mm_add_ps(sq, _mm_movehl_ps(sq, sq)); //(x+z, y+0, ...)
+			sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(1, 1, 1, 1)));
+			best = _mm_max_ss(best, sum);
+		}
+		_mm_store_ss(&farthest, best);
+	}
+#else
+	for (size_t i = 0; i + 1 < count; ++i) {
+		glm::vec3 v = position_at(vertices, stride, i) - bounds.center;
+		farthest = std::max(farthest, glm::dot(v, v));
+	}
+#endif
+	bounds.radius = std::sqrt(farthest);
+
+	return bounds;
+}
+
+MeshBounds bounds_of_box(glm::vec3 const &min, glm::vec3 const &max) {
+	MeshBounds bounds;
+	bounds.min = min;
+	bounds.max = max;
+	bounds.center = 0.5f * (min + max);
+	bounds.radius = 0.5f * glm::length(max - min);
+	return bounds;
+}
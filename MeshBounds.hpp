@@ -0,0 +1,21 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cstddef>
+
+//Bounding volumes of a mesh, in object space (stored per mesh in the "bnd0" chunk; see MeshBlob.hpp):
+struct MeshBounds {
+	glm::vec3 min = glm::vec3(0.0f); //axis-aligned box
+	glm::vec3 max = glm::vec3(0.0f);
+	glm::vec3 center = glm::vec3(0.0f); //sphere (centered on the box, so radius <= half its diagonal)
+	float radius = 0.0f;
+};
+static_assert(sizeof(MeshBounds) == 40, "MeshBounds is packed");
+
+//bounds of 'count' positions, each the first three floats of a 'stride'-byte vertex:
+// (two streaming passes -- min/max, then distance from center -- using SSE where available)
+MeshBounds compute_bounds(void const *vertices, size_t stride, size_t count);
+
+//bounds of a box (for when only the box is known; the sphere is the box's circumsphere):
+MeshBounds bounds_of_box(glm::vec3 const &min, glm::vec3 const &max);
@@ -0,0 +1,499 @@
+#include "MeshImport.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+using namespace MeshChunks;
+
+namespace {
+	std::string read_file(std::string const &filename) {
+		std::ifstream file(filename, std::ios::binary);
+		if (!file) {
+			throw std::runtime_error("Failed to open '" + filename + "'");
+		}
+		std::ostringstream contents;
+		contents << file.rdbuf();
+		return contents.str();
+	}
+
+	//"models/Robot.obj" -> "Robot":
+	std::string stem_of(std::string const &filename) {
+		size_t slash = filename.find_last_of("/\\");
+		std::string base = (slash == std::string::npos ? filename : filename.substr(slash + 1));
+		size_t dot = base.rfind('.');
+		return (dot == std::string::npos || dot == 0 ? base : base.substr(0, dot));
+	}
+
+	std::string trim(std::string const &str) {
+		size_t begin = str.find_first_not_of(" \t\r");
+		if (begin == std::string::npos) return "";
+		size_t end = str.find_last_not_of(" \t\r");
+		return str.substr(begin, end + 1 - begin);
+	}
+
+	//read up to 'count' floats from a null-terminated string; returns how many were read:
+	uint32_t read_floats(char const **_at, float *out, uint32_t count) {
+		char const *&at = *_at;
+		uint32_t read = 0;
+		while (read < count) {
+			char *next = nullptr;
+			float value = std::strtof(at, &next);
+			if (next == at) break;
+			out[read++] = value;
+			at = next;
+		}
+		return read;
+	}
+}
+
+std::vector< ImportedMesh > import_obj(std::string const &filename) {
+	std::string text = read_file(filename);
+
+	//vertex data is file-wide; meshes index into it until they are compacted below:
+	std::vector< glm::vec3 > positions, colors, normals;
+	bool any_colors = false;
+	std::vector< ImportedMesh > meshes;
+	uint32_t smoothing = 0; //(OBJ default is 's off')
+
+	auto current = [&]() -> ImportedMesh & {
+		if (meshes.empty()) {
+			meshes.emplace_back();
+			meshes.back().name = stem_of(filename);
+		}
+		return meshes.back();
+	};
+
+	std::string line;
+	uint32_t line_number = 0;
+	size_t line_begin = 0;
+	while (line_begin < text.size()) {
+		size_t line_end = text.find('\n', line_begin);
+		if (line_end == std::string::npos) line_end = text.size();
+		line.assign(text, line_begin, line_end - line_begin);
+		line_begin = line_end + 1;
+		line_number += 1;
+
+		auto error = [&](std::string const &what) {
+			return std::runtime_error(filename + ":" + std::to_string(line_number) + ": " + what);
+		};
+
+		size_t hash = line.find('#');
+		if (hash != std::string::npos) line.erase(hash);
+		char const *at = line.c_str();
+		while (*at == ' ' || *at == '\t') ++at;
+		char const *keyword_end = at;
+		while (*keyword_end && *keyword_end != ' ' && *keyword_end != '\t' && *keyword_end != '\r') ++keyword_end;
+		std::string keyword(at, keyword_end);
+		at = keyword_end;
+
+		if (keyword == "v") {
+			float values[6];
+			uint32_t count = read_floats(&at, values, 6);
+			if (count != 3 && count != 6) throw error("expecting 'v x y z' or 'v x y z r g b'");
+			positions.emplace_back(values[0], values[1], values[2]);
+			if (count == 6) {
+				any_colors = true;
+				colors.emplace_back(values[3], values[4], values[5]);
+			} else {
+				colors.emplace_back(1.0f);
+			}
+		} else if (keyword == "vn") {
+			float values[3];
+			if (read_floats(&at, values, 3) != 3) throw error("expecting 'vn x y z'");
+			normals.emplace_back(values[0], values[1], values[2]);
+		} else if (keyword == "f") {
+			ImportedMesh &mesh = current();
+			//resolve a (1-based or negative, relative) OBJ index:
+			auto resolve = [&](long index, size_t count) -> uint32_t {
+				long resolved = (index < 0 ? long(count) + index : index - 1);
+				if (index == 0 || resolved < 0 || resolved >= long(count)) throw error("index out of range");
+				return uint32_t(resolved);
+			};
+			uint32_t corner_count = 0;
+			while (true) {
+				while (*at == ' ' || *at == '\t' || *at == '\r') ++at;
+				if (*at == '\0') break;
+				char *next = nullptr;
+				ImportedMesh::Corner corner;
+				corner.position = resolve(std::strtol(at, &next, 10), positions.size());
+				at = next;
+				if (*at == '/') {
+					++at;
+					if (*at != '/') {
+						std::strtol(at, &next, 10); //(texture coordinates aren't stored)
+						at = next;
+					}
+					if (*at == '/') {
+						++at;
+						corner.normal = resolve(std::strtol(at, &next, 10), normals.size());
+						at = next;
+					}
+				}
+				if (*at != '\0' && *at != ' ' && *at != '\t' && *at != '\r') throw error("malformed face vertex");
+				mesh.corners.emplace_back(corner);
+				corner_count += 1;
+			}
+			if (corner_count < 3) throw error("face with fewer than three vertices");
+			mesh.polygon_starts.emplace_back(uint32_t(mesh.corners.size()));
+			mesh.smoothing.emplace_back(smoothing);
+		} else if (keyword == "s") {
+			std::string group = trim(at);
+			smoothing = (group == "off" ? 0 : uint32_t(std::strtoul(group.c_str(), nullptr, 10)));
+		} else if (keyword == "o") {
+			std::string name = trim(at);
+			if (name.empty()) throw error("object with no name");
+			//(an object before any faces just renames the file's default mesh)
+			if (!meshes.empty() && meshes.back().corners.empty()) {
+				meshes.back().name = name;
+			} else {
+				meshes.emplace_back();
+				meshes.back().name = name;
+			}
+		}
+		//(anything else -- vt, g, usemtl, mtllib, l, ... -- doesn't affect the meshes)
+	}
+
+	//give each mesh its own (compact) copies of the vertex data it uses:
+	std::vector< uint32_t > position_remap(positions.size(), -1U);
+	std::vector< uint32_t > normal_remap(normals.size(), -1U);
+	std::vector< ImportedMesh > result;
+	for (auto &mesh : meshes) {
+		if (mesh.corners.empty()) {
+			std::cerr << "WARNING: object '" << mesh.name << "' in '" << filename << "' has no faces; skipping." << std::endl;
+			continue;
+		}
+		std::vector< uint32_t > used_positions, used_normals;
+		for (auto &corner : mesh.corners) {
+			uint32_t &p = position_remap[corner.position];
+			if (p == -1U) {
+				p = uint32_t(mesh.positions.size());
+				mesh.positions.emplace_back(positions[corner.position]);
+				if (any_colors) mesh.colors.emplace_back(colors[corner.position]);
+				used_positions.emplace_back(corner.position);
+			}
+			corner.position = p;
+			if (corner.normal != -1U) {
+				uint32_t &n = normal_remap[corner.normal];
+				if (n == -1U) {
+					n = uint32_t(mesh.normals.size());
+					mesh.normals.emplace_back(normals[corner.normal]);
+					used_normals.emplace_back(corner.normal);
+				}
+				corner.normal = n;
+			}
+		}
+		for (uint32_t p : used_positions) position_remap[p] = -1U;
+		for (uint32_t n : used_normals) normal_remap[n] = -1U;
+		result.emplace_back(std::move(mesh));
+	}
+	return result;
+}
+
+namespace {
+	//reads PLY element data, in any of the three PLY formats:
+	struct PlyReader {
+		enum Format { Ascii, BinaryLittleEndian, BinaryBigEndian } format = Ascii;
+		char const *at = nullptr;
+		char const *end = nullptr;
+
+		double read(std::string const &type) {
+			if (format == Ascii) {
+				while (at < end && std::isspace(uint8_t(*at))) ++at;
+				char const *token_end = at;
+				while (token_end < end && !std::isspace(uint8_t(*token_end))) ++token_end;
+				std::string token(at, token_end);
+				char *parsed = nullptr;
+				double value = std::strtod(token.c_str(), &parsed);
+				if (token.empty() || parsed != token.c_str() + token.size()) {
+					throw std::runtime_error("PLY data has a malformed (or missing) value");
+				}
+				at = token_end;
+				return value;
+			}
+			size_t size = size_of(type);
+			if (size_t(end - at) < size) {
+				throw std::runtime_error("PLY data ends early");
+			}
+			char bytes[8];
+			std::memcpy(bytes, at, size);
+			at += size;
+			if (format == BinaryBigEndian) std::reverse(bytes, bytes + size); //(assumes a little-endian host, as the blobs do)
+			if (type == "char" || type == "int8") { int8_t v; std::memcpy(&v, bytes, 1); return v; }
+			if (type == "uchar" || type == "uint8") { uint8_t v; std::memcpy(&v, bytes, 1); return v; }
+			if (type == "short" || type == "int16") { int16_t v; std::memcpy(&v, bytes, 2); return v; }
+			if (type == "ushort" || type == "uint16") { uint16_t v; std::memcpy(&v, bytes, 2); return v; }
+			if (type == "int" || type == "int32") { int32_t v; std::memcpy(&v, bytes, 4); return v; }
+			if (type == "uint" || type == "uint32") { uint32_t v; std::memcpy(&v, bytes, 4); return v; }
+			if (type == "float" || type == "float32") { float v; std::memcpy(&v, bytes, 4); return v; }
+			double v; std::memcpy(&v, bytes, 8); return v;
+		}
+
+		static size_t size_of(std::string const &type) {
+			if (type == "char" || type == "int8" || type == "uchar" || type == "uint8") return 1;
+			if (type == "short" || type == "int16" || type == "ushort" || type == "uint16") return 2;
+			if (type == "int" || type == "int32" || type == "uint" || type == "uint32" || type == "float" || type == "float32") return 4;
+			if (type == "double" || type == "float64") return 8;
+			throw std::runtime_error("PLY property has unknown type '" + type + "'");
+		}
+	};
+}
+
+std::vector< ImportedMesh > import_ply(std::string const &filename) {
+	std::string text = read_file(filename);
+
+	struct Property {
+		std::string name;
+		std::string type; //(item type, for lists)
+		std::string count_type; //non-empty for lists
+	};
+	struct Element {
+		std::string name;
+		uint64_t count = 0;
+		std::vector< Property > properties;
+	};
+	std::vector< Element > elements;
+	PlyReader reader;
+
+	{ //header:
+		size_t header_end = text.find("end_header");
+		if (text.compare(0, 3, "ply") != 0 || header_end == std::string::npos) {
+			throw std::runtime_error("'" + filename + "' doesn't have a PLY header");
+		}
+		size_t data_begin = text.find('\n', header_end);
+		data_begin = (data_begin == std::string::npos ? text.size() : data_begin + 1);
+		std::istringstream header(text.substr(0, header_end));
+		std::string line;
+		bool have_format = false;
+		while (std::getline(header, line)) {
+			std::istringstream words(line);
+			std::string keyword;
+			words >> keyword;
+			if (keyword == "format") {
+				std::string format;
+				words >> format;
+				if (format == "ascii") reader.format = PlyReader::Ascii;
+				else if (format == "binary_little_endian") reader.format = PlyReader::BinaryLittleEndian;
+				else if (format == "binary_big_endian") reader.format = PlyReader::BinaryBigEndian;
+				else throw std::runtime_error("'" + filename + "' has unknown PLY format '" + format + "'");
+				have_format = true;
+			} else if (keyword == "element") {
+				elements.emplace_back();
+				if (!(words >> elements.back().name >> elements.back().count)) {
+					throw std::runtime_error("'" + filename + "' has a malformed PLY element line");
+				}
+			} else if (keyword == "property") {
+				if (elements.empty()) {
+					throw std::runtime_error("'" + filename + "' has a PLY property before any element");
+				}
+				Property property;
+				std::string type;
+				words >> type;
+				if (type == "list") words >> property.count_type >> property.type;
+				else property.type = type;
+				if (!(words >> property.name)) {
+					throw std::runtime_error("'" + filename + "' has a malformed PLY property line");
+				}
+				PlyReader::size_of(property.type); //(check type)
+				if (!property.count_type.empty()) PlyReader::size_of(property.count_type);
+				elements.back().properties.emplace_back(property);
+			}
+			//(comment, obj_info, and the magic line itself need no handling)
+		}
+		if (!have_format) {
+			throw std::runtime_error("'" + filename + "' doesn't specify a PLY format");
+		}
+		reader.at = text.data() + data_begin;
+		reader.end = text.data() + text.size();
+	}
+
+	ImportedMesh mesh;
+	mesh.name = stem_of(filename);
+	bool have_normals = false;
+	bool have_colors = false;
+
+	for (auto const &element : elements) {
+		bool is_vertex = (element.name == "vertex");
+		bool is_face = (element.name == "face");
+		if (is_vertex) {
+			for (auto const &property : element.properties) {
+				if (property.name == "nx") have_normals = true;
+				if (property.name == "red") have_colors = true;
+			}
+		}
+		for (uint64_t i = 0; i < element.count; ++i) {
+			glm::vec3 position(0.0f), normal(0.0f), color(1.0f);
+			for (auto const &property : element.properties) {
+				if (!property.count_type.empty()) {
+					uint64_t count = uint64_t(reader.read(property.count_type));
+					bool indices = is_face && (property.name == "vertex_indices" || property.name == "vertex_index");
+					for (uint64_t c = 0; c < count; ++c) {
+						double value = reader.read(property.type);
+						if (!indices) continue;
+						if (!(value >= 0.0 && value < double(mesh.positions.size()))) {
+							throw std::runtime_error("'" + filename + "' has a face with an out-of-range vertex index");
+						}
+						ImportedMesh::Corner corner;
+						corner.position = uint32_t(value);
+						if (have_normals) corner.normal = corner.position;
+						mesh.corners.emplace_back(corner);
+					}
+					if (indices) {
+						if (count < 3) throw std::runtime_error("'" + filename + "' has a face with fewer than three vertices");
+						mesh.polygon_starts.emplace_back(uint32_t(mesh.corners.size()));
+						mesh.smoothing.emplace_back(1); //(vertices are shared, so generated normals are smooth)
+					}
+					continue;
+				}
+				double value = reader.read(property.type);
+				if (!is_vertex) continue;
+				//integer colors are 0..255; float colors are 0..1:
+				float channel = float(PlyReader::size_of(property.type) == 1 ? value / 255.0 : value);
+				if (property.name == "x") position.x = float(value);
+				else if (property.name == "y") position.y = float(value);
+				else if (property.name == "z") position.z = float(value);
+				else if (property.name == "nx") normal.x = float(value);
+				else if (property.name == "ny") normal.y = float(value);
+				else if (property.name == "nz") normal.z = float(value);
+				else if (property.name == "red") color.x = channel;
+				else if (property.name == "green") color.y = channel;
+				else if (property.name == "blue") color.z = channel;
+			}
+			if (is_vertex) {
+				mesh.positions.emplace_back(position);
+				if (have_normals) mesh.normals.emplace_back(normal);
+				if (have_colors) mesh.colors.emplace_back(color);
+			}
+		}
+	}
+
+	std::vector< ImportedMesh > result;
+	if (mesh.corners.empty()) {
+		std::cerr << "WARNING: '" << filename << "' has no faces; skipping." << std::endl;
+	} else {
+		result.emplace_back(std::move(mesh));
+	}
+	return result;
+}
+
+namespace {
+	//quantization helpers for the compact format (match models/export-meshes.py):
+	uint16_t quantize_unorm16(float x, float lo, float hi) {
+		if (hi <= lo) return 0;
+		return uint16_t(std::max(0L, std::min(65535L, std::lround((x - lo) / (hi - lo) * 65535.0f))));
+	}
+	int16_t quantize_snorm16(float x) {
+		return int16_t(std::max(-32767L, std::min(32767L, std::lround(x * 32767.0f))));
+	}
+	uint8_t quantize_unorm8(float x) {
+		return uint8_t(std::max(0L, std::min(255L, std::lround(x * 255.0f))));
+	}
+	void encode_octahedral(glm::vec3 const &n, int16_t *out) {
+		float l = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+		if (l == 0.0f) {
+			out[0] = out[1] = 0;
+			return;
+		}
+		float x = n.x / l, y = n.y / l;
+		if (n.z < 0.0f) {
+			float fx = (1.0f - std::abs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+			float fy = (1.0f - std::abs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+			x = fx;
+			y = fy;
+		}
+		out[0] = quantize_snorm16(x);
+		out[1] = quantize_snorm16(y);
+	}
+}
+
+void cook_mesh(ImportedMesh const &mesh, bool compact, MeshBlob::Mesh *_out) {
+	auto &out = *_out;
+	uint32_t polygon_count = uint32_t(mesh.polygon_starts.size() - 1);
+
+	//polygon normals by Newell's method (fine for non-planar polygons; length is twice the area):
+	std::vector< glm::vec3 > polygon_normals(polygon_count, glm::vec3(0.0f));
+	for (uint32_t p = 0; p < polygon_count; ++p) {
+		uint32_t begin = mesh.polygon_starts[p], end = mesh.polygon_starts[p+1];
+		glm::vec3 &n = polygon_normals[p];
+		for (uint32_t c = begin; c < end; ++c) {
+			glm::vec3 const &a = mesh.positions[mesh.corners[c].position];
+			glm::vec3 const &b = mesh.positions[mesh.corners[c + 1 < end ? c + 1 : begin].position];
+			n.x += (a.y - b.y) * (a.z + b.z);
+			n.y += (a.z - b.z) * (a.x + b.x);
+			n.z += (a.x - b.x) * (a.y + b.y);
+		}
+	}
+
+	//generated smooth normals: area-weighted sum over the polygons of a smoothing group around each position:
+	auto smooth_key = [](uint32_t group, uint32_t position) { return (uint64_t(group) << 32) | position; };
+	std::unordered_map< uint64_t, glm::vec3 > smooth_normals;
+	for (uint32_t p = 0; p < polygon_count; ++p) {
+		if (mesh.smoothing[p] == 0) continue;
+		for (uint32_t c = mesh.polygon_starts[p]; c < mesh.polygon_starts[p+1]; ++c) {
+			if (mesh.corners[c].normal != -1U) continue;
+			auto f = smooth_normals.insert(std::make_pair(smooth_key(mesh.smoothing[p], mesh.corners[c].position), glm::vec3(0.0f))).first;
+			f->second += polygon_normals[p];
+		}
+	}
+
+	auto safe_normalize = [](glm::vec3 const &n) {
+		float length = glm::length(n);
+		return (length > 0.0f ? n / length : glm::vec3(0.0f, 0.0f, 1.0f));
+	};
+
+	//triangulate as fans:
+	std::vector< v3n3c3 > vertices;
+	vertices.reserve(3 * (mesh.corners.size() - 2 * polygon_count));
+	for (uint32_t p = 0; p < polygon_count; ++p) {
+		uint32_t begin = mesh.polygon_starts[p], end = mesh.polygon_starts[p+1];
+		auto emit = [&](uint32_t c) {
+			ImportedMesh::Corner const &corner = mesh.corners[c];
+			v3n3c3 vertex;
+			vertex.v = mesh.positions[corner.position];
+			if (corner.normal != -1U) vertex.n = safe_normalize(mesh.normals[corner.normal]);
+			else if (mesh.smoothing[p] == 0) vertex.n = safe_normalize(polygon_normals[p]);
+			else vertex.n = safe_normalize(smooth_normals[smooth_key(mesh.smoothing[p], corner.position)]);
+			vertex.c = (mesh.colors.empty() ? glm::vec3(1.0f) : mesh.colors[corner.position]);
+			vertices.emplace_back(vertex);
+		};
+		for (uint32_t c = begin + 1; c + 1 < end; ++c) {
+			emit(begin);
+			emit(c);
+			emit(c + 1);
+		}
+	}
+
+	out.name = mesh.name;
+	out.indexed = false;
+	out.indices.clear();
+	if (!compact) {
+		out.vertices.assign(reinterpret_cast< char const * >(vertices.data()), reinterpret_cast< char const * >(vertices.data() + vertices.size()));
+		return;
+	}
+
+	out.min = out.max = (vertices.empty() ? glm::vec3(0.0f) : vertices[0].v);
+	for (auto const &vertex : vertices) {
+		out.min = glm::min(out.min, vertex.v);
+		out.max = glm::max(out.max, vertex.v);
+	}
+	out.vertices.resize(vertices.size() * sizeof(q3n2c4));
+	for (uint32_t i = 0; i < vertices.size(); ++i) {
+		v3n3c3 const &vertex = vertices[i];
+		q3n2c4 packed;
+		for (uint32_t c = 0; c < 3; ++c) {
+			packed.v[c] = quantize_unorm16(vertex.v[c], out.min[c], out.max[c]);
+			packed.c[c] = quantize_unorm8(vertex.c[c]);
+		}
+		packed.pad = 0;
+		packed.c[3] = 255;
+		encode_octahedral(vertex.n, packed.n);
+		std::memcpy(out.vertices.data() + i * sizeof(q3n2c4), &packed, sizeof(q3n2c4));
+	}
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "MeshBlob.hpp"
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+//Readers for interchange mesh formats (used by blobcook):
+
+//"ImportedMesh" is a set of polygons as read from a file, before triangulation:
+struct ImportedMesh {
+	std::string name;
+	std::vector< glm::vec3 > positions;
+	std::vector< glm::vec3 > colors; //per position (empty if the file has none)
+	std::vector< glm::vec3 > normals; //referenced by corners (empty if the file has none)
+	struct Corner {
+		uint32_t position;
+		uint32_t normal = -1U; //-1U if the corner has no normal (one will be generated)
+	};
+	std::vector< Corner > corners;
+	//polygon p uses corners [polygon_starts[p], polygon_starts[p+1]):
+	std::vector< uint32_t > polygon_starts = std::vector< uint32_t >(1, 0);
+	std::vector< uint32_t > smoothing; //per polygon; 0 = flat shaded, otherwise generated normals are shared within a group
+};
+
+//read every object ('o' line) in a Wavefront OBJ file as a mesh:
+// supports v (optionally with an r g b color), vn, f (with v, v/vt, v//vn, v/vt/vn and negative indices), s, o.
+// meshes from files without 'o' lines are named for the file.
+// note: will throw if file fails to read or parse.
+std::vector< ImportedMesh > import_obj(std::string const &filename);
+
+//read a PLY file (ascii or binary) as one mesh, named for the file:
+// uses vertex x y z [nx ny nz] [red green blue] and face vertex_indices (or vertex_index) properties.
+// note: will throw if file fails to read or parse.
+std::vector< ImportedMesh > import_ply(std::string const &filename);
+
+//triangulate (as fans) and fill in missing normals, writing triangle-soup vertices to 'out':
+// (compact meshes are quantized against their bounding box, which is stored in out->min/max)
+void cook_mesh(ImportedMesh const &mesh, bool compact, MeshBlob::Mesh *out);
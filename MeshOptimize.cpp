@@ -0,0 +1,203 @@
+#include "MeshOptimize.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <deque>
+
+VertexCacheStats analyze_vertex_cache(std::vector< uint32_t > const &indices, uint32_t vertex_count, uint32_t cache_size) {
+	VertexCacheStats stats;
+	stats.triangles = uint32_t(indices.size() / 3);
+
+	//FIFO cache, tracked by the time each vertex entered it:
+	std::vector< uint32_t > entered(vertex_count, 0);
+	std::vector< bool > used(vertex_count, false);
+	uint32_t time = cache_size + 1;
+	for (uint32_t i : indices) {
+		assert(i < vertex_count);
+		if (!used[i]) {
+			used[i] = true;
+			stats.vertices += 1;
+		}
+		if (time - entered[i] > cache_size) {
+			stats.misses += 1;
+			entered[i] = time;
+			time += 1;
+		}
+	}
+	return stats;
+}
+
+void optimize_vertex_cache(std::vector< uint32_t > *_indices, uint32_t vertex_count, uint32_t cache_size, std::vector< uint32_t > *_cluster_starts) {
+	assert(_indices);
+	assert(_cluster_starts);
+	auto const &indices = *_indices;
+	auto &cluster_starts = *_cluster_starts;
+	uint32_t triangle_count = uint32_t(indices.size() / 3);
+
+	cluster_starts.clear();
+	if (triangle_count == 0) return;
+
+	//vertex -> triangle adjacency (compressed rows):
+	std::vector< uint32_t > live(vertex_count, 0); //triangles still to be emitted, per vertex
+	for (uint32_t i : indices) live[i] += 1;
+	std::vector< uint32_t > offsets(vertex_count + 1, 0);
+	for (uint32_t v = 0; v < vertex_count; ++v) offsets[v+1] = offsets[v] + live[v];
+	std::vector< uint32_t > adjacency(offsets.back());
+	{
+		std::vector< uint32_t > fill(offsets.begin(), offsets.end() - 1);
+		for (uint32_t t = 0; t < triangle_count; ++t) {
+			for (uint32_t c = 0; c < 3; ++c) {
+				adjacency[fill[indices[3*t+c]]++] = t;
+			}
+		}
+	}
+
+	std::vector< uint32_t > cache_time(vertex_count, 0);
+	std::vector< bool > emitted(triangle_count, false);
+	std::vector< uint32_t > dead_end; //stack of recently-used vertices
+	std::vector< uint32_t > candidates;
+	std::vector< uint32_t > output;
+	output.reserve(indices.size());
+
+	uint32_t time = cache_size + 1;
+	uint32_t cursor = 0; //for scanning for a vertex with live triangles when stuck
+
+	auto skip_dead_end = [&]() -> int64_t {
+		while (!dead_end.empty()) {
+			uint32_t d = dead_end.back();
+			dead_end.pop_back();
+			if (live[d] > 0) return d;
+		}
+		while (cursor < vertex_count) {
+			if (live[cursor] > 0) return cursor;
+			++cursor;
+		}
+		return -1;
+	};
+
+	int64_t fanning = skip_dead_end();
+	cluster_starts.emplace_back(0);
+	while (fanning >= 0) {
+		candidates.clear();
+		//emit all remaining triangles around the fanning vertex:
+		for (uint32_t a = offsets[fanning]; a < offsets[fanning+1]; ++a) {
+			uint32_t t = adjacency[a];
+			if (emitted[t]) continue;
+			emitted[t] = true;
+			for (uint32_t c = 0; c < 3; ++c) {
+				uint32_t v = indices[3*t+c];
+				output.emplace_back(v);
+				dead_end.emplace_back(v);
+				candidates.emplace_back(v);
+				live[v] -= 1;
+				if (time - cache_time[v] > cache_size) {
+					cache_time[v] = time;
+					time += 1;
+				}
+			}
+		}
+		//pick the next fanning vertex: the oldest candidate that will still be in cache after its fan:
+		int64_t next = -1;
+		int64_t best = -1;
+		for (uint32_t v : candidates) {
+			if (live[v] == 0) continue;
+			int64_t priority = 0;
+			if (time - cache_time[v] + 2 * live[v] <= cache_size) {
+				priority = time - cache_time[v];
+			}
+			if (priority > best) {
+				best = priority;
+				next = v;
+			}
+		}
+		if (next < 0) {
+			next = skip_dead_end();
+			//no good neighbor, so the cache is effectively flushed -- a natural cluster boundary:
+			if (next >= 0) cluster_starts.emplace_back(uint32_t(output.size() / 3));
+		}
+		fanning = next;
+	}
+	assert(output.size() == indices.size());
+	_indices->swap(output);
+}
+
+void optimize_overdraw(std::vector< uint32_t > *_indices, std::vector< glm::vec3 > const &positions, std::vector< uint32_t > const &cluster_starts) {
+	assert(_indices);
+	auto &indices = *_indices;
+	uint32_t triangle_count = uint32_t(indices.size() / 3);
+	if (cluster_starts.size() <= 1) return;
+
+	struct Cluster {
+		uint32_t begin, end; //triangle range
+		glm::vec3 centroid = glm::vec3(0.0f); //area-weighted
+		glm::vec3 normal = glm::vec3(0.0f); //area-weighted
+		float sort_key = 0.0f;
+	};
+	std::vector< Cluster > clusters;
+	clusters.reserve(cluster_starts.size());
+	for (uint32_t c = 0; c < cluster_starts.size(); ++c) {
+		Cluster cluster;
+		cluster.begin = cluster_starts[c];
+		cluster.end = (c + 1 < cluster_starts.size() ? cluster_starts[c+1] : triangle_count);
+		clusters.emplace_back(cluster);
+	}
+
+	glm::vec3 mesh_centroid = glm::vec3(0.0f);
+	float mesh_area = 0.0f;
+	for (auto &cluster : clusters) {
+		float area = 0.0f;
+		for (uint32_t t = cluster.begin; t < cluster.end; ++t) {
+			glm::vec3 const &a = positions[indices[3*t+0]];
+			glm::vec3 const &b = positions[indices[3*t+1]];
+			glm::vec3 const &c = positions[indices[3*t+2]];
+			glm::vec3 n = glm::cross(b - a, c - a); //length is twice the area
+			float w = glm::length(n);
+			cluster.centroid += w * (a + b + c) / 3.0f;
+			cluster.normal += n;
+			area += w;
+		}
+		mesh_centroid += cluster.centroid;
+		mesh_area += area;
+		if (area > 0.0f) cluster.centroid /= area;
+	}
+	if (mesh_area > 0.0f) mesh_centroid /= mesh_area;
+
+	//clusters that face away from the center (and sit far from it) are likely to occlude the rest:
+	for (auto &cluster : clusters) {
+		float length = glm::length(cluster.normal);
+		glm::vec3 normal = (length > 0.0f ? cluster.normal / length : glm::vec3(0.0f));
+		cluster.sort_key = glm::dot(cluster.centroid - mesh_centroid, normal);
+	}
+	std::stable_sort(clusters.begin(), clusters.end(), [](Cluster const &a, Cluster const &b) {
+		return a.sort_key > b.sort_key;
+	});
+
+	std::vector< uint32_t > output;
+	output.reserve(indices.size());
+	for (auto const &cluster : clusters) {
+		output.insert(output.end(), indices.begin() + 3 * cluster.begin, indices.begin() + 3 * cluster.end);
+	}
+	indices.swap(output);
+}
+
+void optimize_vertex_fetch(MeshBlob const &blob, MeshBlob::Mesh *_mesh) {
+	assert(_mesh);
+	auto &mesh = *_mesh;
+	assert(mesh.indexed);
+	uint32_t vertex_size = blob.vertex_size();
+	uint32_t vertex_count = mesh.vertex_count(blob);
+
+	std::vector< uint32_t > remap(vertex_count, -1U);
+	std::vector< char > vertices;
+	vertices.reserve(mesh.vertices.size());
+	uint32_t next = 0;
+	for (auto &i : mesh.indices) {
+		if (remap[i] == -1U) {
+			remap[i] = next++;
+			vertices.insert(vertices.end(), mesh.vertices.begin() + i * vertex_size, mesh.vertices.begin() + (i + 1) * vertex_size);
+		}
+		i = remap[i];
+	}
+	mesh.vertices.swap(vertices);
+}
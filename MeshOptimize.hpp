@@ -0,0 +1,29 @@
+#pragma once
+
+#include "MeshBlob.hpp"
+
+#include <vector>
+#include <stdint.h>
+
+//Offline triangle/vertex order optimizations for indexed meshes (used by optimize-meshes):
+
+//post-transform cache statistics for an index list, simulated with a FIFO cache:
+struct VertexCacheStats {
+	uint32_t misses = 0;
+	uint32_t triangles = 0;
+	uint32_t vertices = 0; //distinct vertices referenced
+	float acmr() const { return triangles ? float(misses) / float(triangles) : 0.0f; } //average cache miss ratio (per triangle; 0.5 is ideal)
+	float atvr() const { return vertices ? float(misses) / float(vertices) : 0.0f; } //average transformed vertex ratio (1.0 is ideal)
+};
+VertexCacheStats analyze_vertex_cache(std::vector< uint32_t > const &indices, uint32_t vertex_count, uint32_t cache_size = 16);
+
+//reorder triangles for post-transform cache reuse ("Tipsify", Sander et al. 2007):
+// also returns the first triangle of each cluster (points where the cache was flushed),
+// which optimize_overdraw may reorder without hurting cache efficiency much.
+void optimize_vertex_cache(std::vector< uint32_t > *indices, uint32_t vertex_count, uint32_t cache_size, std::vector< uint32_t > *cluster_starts);
+
+//reorder clusters so that outward-facing clusters far from the mesh's center draw first (likely occluders):
+void optimize_overdraw(std::vector< uint32_t > *indices, std::vector< glm::vec3 > const &positions, std::vector< uint32_t > const &cluster_starts);
+
+//renumber vertices in order of first use by the index list (dropping unused vertices):
+void optimize_vertex_fetch(MeshBlob const &blob, MeshBlob::Mesh *mesh);
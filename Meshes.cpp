@@ -1,101 +1,657 @@
 #include "Meshes.hpp"
-#include "read_chunk.hpp"
-
-#include <glm/glm.hpp>
+#include "MeshBlob.hpp"
 
 #include <stdexcept>
-#include <fstream>
 #include <iostream>
 #include <vector>
 #include <string>
+#include <cstring>
+#include <algorithm>
+#include <chrono>
 
-void Meshes::load(std::string const &filename, Attributes const &attributes) {
-	std::ifstream file(filename, std::ios::binary);
+using namespace MeshChunks;
 
-	GLuint vao = 0;
-	GLuint total = 0;
-	{ //read + upload data chunk:
-		struct v3n3c3 {
-			glm::vec3 v;
-			glm::vec3 n;
-			glm::vec3 c;
-		};
-		static_assert(sizeof(v3n3c3) == 36, "v3n3c3 is packed");
-		std::vector< v3n3c3 > data;
-		read_chunk(file, "v3n3", &data);
-
-		//upload data:
-		GLuint buffer = 0;
-		glGenBuffers(1, &buffer);
-		glBindBuffer(GL_ARRAY_BUFFER, buffer);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(v3n3c3) * data.size(), &data[0], GL_STATIC_DRAW);
-
-		total = data.size(); //store total for later checks on index
-
-		//store binding:
-		glGenVertexArrays(1, &vao);
-		glBindVertexArray(vao);
-		if (attributes.Position != -1U) {
-			glVertexAttribPointer(attributes.Position, 3, GL_FLOAT, GL_FALSE, sizeof(v3n3c3), (GLbyte *)0);
-			glEnableVertexAttribArray(attributes.Position);
-		} else {
-			std::cerr << "WARNING: loading v3n3c3 data from '" << filename << "', but not using the Position attribute." << std::endl;
+namespace {
+	void warn_unused_attributes(std::string const &filename, bool compact, Meshes::Attributes const &attributes) {
+		char const *format = (compact ? "q3n2c4" : "v3n3c3");
+		if (attributes.Position == -1U) {
+			std::cerr << "WARNING: loading " << format << " data from '" << filename << "', but not using the Position attribute." << std::endl;
+		}
+		if ((compact ? attributes.NormalOct : attributes.Normal) == -1U) {
+			std::cerr << "WARNING: loading " << format << " data from '" << filename << "', but not using the " << (compact ? "NormalOct" : "Normal") << " attribute." << std::endl;
+		}
+		if (attributes.Color == -1U) {
+			std::cerr << "WARNING: loading " << format << " data from '" << filename << "', but not using the Color attribute." << std::endl;
 		}
-		if (attributes.Normal != -1U) {
-			glVertexAttribPointer(attributes.Normal, 3, GL_FLOAT, GL_FALSE, sizeof(v3n3c3), (GLbyte *)0 + sizeof(glm::vec3));
-			glEnableVertexAttribArray(attributes.Normal);
+	}
+
+	//point the bound VAO's attributes at the vertex buffer bound to GL_ARRAY_BUFFER:
+	void set_attributes(bool compact, Meshes::Attributes const &attributes) {
+		if (compact) {
+			if (attributes.Position != -1U) {
+				glVertexAttribPointer(attributes.Position, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(q3n2c4), (GLbyte *)0 + offsetof(q3n2c4, v));
+				glEnableVertexAttribArray(attributes.Position);
+			}
+			if (attributes.NormalOct != -1U) {
+				glVertexAttribPointer(attributes.NormalOct, 2, GL_SHORT, GL_TRUE, sizeof(q3n2c4), (GLbyte *)0 + offsetof(q3n2c4, n));
+				glEnableVertexAttribArray(attributes.NormalOct);
+			}
+			if (attributes.Color != -1U) {
+				glVertexAttribPointer(attributes.Color, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(q3n2c4), (GLbyte *)0 + offsetof(q3n2c4, c));
+				glEnableVertexAttribArray(attributes.Color);
+			}
 		} else {
-			std::cerr << "WARNING: loading v3n3c3 data from '" << filename << "', but not using the Normal attribute." << std::endl;
+			if (attributes.Position != -1U) {
+				glVertexAttribPointer(attributes.Position, 3, GL_FLOAT, GL_FALSE, sizeof(v3n3c3), (GLbyte *)0);
+				glEnableVertexAttribArray(attributes.Position);
+			}
+			if (attributes.Normal != -1U) {
+				glVertexAttribPointer(attributes.Normal, 3, GL_FLOAT, GL_FALSE, sizeof(v3n3c3), (GLbyte *)0 + sizeof(glm::vec3));
+				glEnableVertexAttribArray(attributes.Normal);
+			}
+			if (attributes.Color != -1U) {
+				glVertexAttribPointer(attributes.Color, 3, GL_FLOAT, GL_FALSE, sizeof(v3n3c3), (GLbyte *)0 + 2*sizeof(glm::vec3));
+				glEnableVertexAttribArray(attributes.Color);
+			}
+		}
+	}
+
+	//move a mesh's ranges to where its file's data landed in the arenas:
+	void place(Mesh *mesh, Meshes::VertexArena const &arena, size_t vertex_base, size_t index_base) {
+		GLuint first_vertex = GLuint(vertex_base / arena.vertices.unit);
+		mesh->vao = arena.vao;
+		mesh->start += first_vertex;
+		if (mesh->index_type) {
+			mesh->base_vertex += first_vertex;
+			mesh->index_start += GLuint(index_base);
+		}
+	}
+
+	//check an elm0 entry against the ind0 chunk and its mesh, and fill in the mesh's index range:
+	void set_elements(Mesh *mesh, ElementEntry const &entry, size_t index_bytes, uint32_t vertex_count) {
+		if (!((entry.index_size == 2 || entry.index_size == 4)
+			&& entry.index_start % 4 == 0
+			&& entry.index_start <= index_bytes
+			&& uint64_t(entry.index_count) * entry.index_size <= index_bytes - entry.index_start)) {
+			throw std::runtime_error("element entry has out-of-range index start/count/size");
+		}
+		if (entry.index_size == 2 && vertex_count > 0x10000) {
+			throw std::runtime_error("element entry uses 16-bit indices for a mesh with too many vertices");
 		}
-		if (attributes.Color != -1U) {
-			glVertexAttribPointer(attributes.Color, 3, GL_FLOAT, GL_FALSE, sizeof(v3n3c3), (GLbyte *)0 + 2*sizeof(glm::vec3));
-			glEnableVertexAttribArray(attributes.Color);
+		mesh->index_type = (entry.index_size == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT);
+		mesh->index_start = entry.index_start;
+		mesh->index_count = entry.index_count;
+	}
+
+	//check that a mesh's indices (at 'data') all refer to its own vertices -- otherwise draws would read
+	// other meshes' vertices, or past the end of the shared vertex buffer:
+	void check_indices(char const *data, GLenum index_type, uint32_t index_count, uint32_t vertex_count) {
+		uint32_t max_index = 0;
+		if (index_type == GL_UNSIGNED_SHORT) {
+			for (uint32_t i = 0; i < index_count; ++i) {
+				uint16_t index;
+				std::memcpy(&index, data + 2 * i, 2);
+				max_index = std::max< uint32_t >(max_index, index);
+			}
 		} else {
-			std::cerr << "WARNING: loading v3n3c3 data from '" << filename << "', but not using the Color attribute." << std::endl;
+			for (uint32_t i = 0; i < index_count; ++i) {
+				uint32_t index;
+				std::memcpy(&index, data + 4 * i, 4);
+				max_index = std::max(max_index, index);
+			}
+		}
+		if (index_count != 0 && max_index >= vertex_count) {
+			throw std::runtime_error("element entry has index " + std::to_string(max_index) + " past its mesh's " + std::to_string(vertex_count) + " vertices");
 		}
 	}
 
-	std::vector< char > strings;
-	read_chunk(file, "str0", &strings);
+	//fill in a compact mesh's dequantization from its bounding box:
+	void set_dequantize(Mesh *mesh, glm::vec3 const &min, glm::vec3 const &max) {
+		mesh->compact = true;
+		mesh->dequantize_offset = min;
+		mesh->dequantize_scale = max - min;
+	}
 
-	{ //read index chunk, add to meshes:
-		struct IndexEntry {
-			uint32_t name_begin, name_end;
-			uint32_t vertex_start, vertex_count;
-		};
-		static_assert(sizeof(IndexEntry) == 16, "Index entry should be packed");
+	//read + validate a whole mesh file (no GL calls, so this is safe to run on a worker thread):
+	std::shared_ptr< Meshes::Parsed > parse_file(std::unique_ptr< ChunkFile > &&_file, std::string const &filename) {
+		std::shared_ptr< Meshes::Parsed > parsed = std::make_shared< Meshes::Parsed >();
+		parsed->file = std::move(_file);
+		ChunkFile &file = *parsed->file;
+
+		if (file.peek_magic() == "toc0") {
+			file.read< char >("toc0"); //directory isn't needed when reading front-to-back
+		}
+
+		parsed->compact = (file.peek_magic() == "q3n2");
+		size_t vertex_size = (parsed->compact ? sizeof(q3n2c4) : sizeof(v3n3c3));
+		parsed->vertex_data = file.read< char >(parsed->compact ? "q3n2" : "v3n3");
+		if (parsed->vertex_data.size % vertex_size != 0) {
+			throw std::runtime_error("Size of chunk not divisible by element size");
+		}
+		GLuint total = GLuint(parsed->vertex_data.size / vertex_size); //store total for later checks on index
 
-		std::vector< IndexEntry > index;
-		read_chunk(file, "idx0", &index);
+		ChunkView< char > strings = file.read< char >("str0");
 
-		for (auto const &entry : index) {
-			if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
+		auto add_mesh = [&](uint32_t name_begin, uint32_t name_end, uint32_t vertex_start, uint32_t vertex_count) -> Mesh & {
+			if (!(name_begin <= name_end && name_end <= strings.size)) {
 				throw std::runtime_error("index entry has out-of-range name begin/end");
 			}
-			if (!(entry.vertex_start < entry.vertex_start + entry.vertex_count && entry.vertex_start + entry.vertex_count <= total)) {
+			if (!(vertex_start < vertex_start + vertex_count && vertex_start + vertex_count <= total)) {
 				throw std::runtime_error("index entry has out-of-range vertex start/count");
 			}
-			std::string name(&strings[0] + entry.name_begin, &strings[0] + entry.name_end);
 			Mesh mesh;
-			mesh.vao = vao;
-			mesh.start = entry.vertex_start;
-			mesh.count = entry.vertex_count;
-			bool inserted = meshes.insert(std::make_pair(name, mesh)).second;
-			if (!inserted) {
-				std::cerr << "WARNING: mesh name '" + name + "' in filename '" + filename + "' collides with existing mesh." << std::endl;
+			mesh.start = vertex_start;
+			mesh.count = vertex_count;
+			parsed->meshes.emplace_back(std::string(strings.data + name_begin, strings.data + name_end), mesh);
+			return parsed->meshes.back().second;
+		};
+
+		//read index chunk:
+		if (parsed->compact) {
+			for (auto const &entry : file.read< CompactIndexEntry >("idq0")) {
+				Mesh &mesh = add_mesh(entry.name_begin, entry.name_end, entry.vertex_start, entry.vertex_count);
+				set_dequantize(&mesh, entry.min, entry.max);
+			}
+		} else {
+			for (auto const &entry : file.read< IndexEntry >("idx0")) {
+				add_mesh(entry.name_begin, entry.name_end, entry.vertex_start, entry.vertex_count);
+			}
+		}
+
+		//optional index data -- switches meshes over to indexed drawing:
+		if (file.peek_magic() == "ind0") {
+			parsed->index_data = file.read< char >("ind0");
+			ChunkView< ElementEntry > elements = file.read< ElementEntry >("elm0");
+			if (elements.size != parsed->meshes.size()) {
+				throw std::runtime_error("elm0 chunk in '" + filename + "' doesn't have one entry per mesh");
+			}
+			for (uint32_t i = 0; i < elements.size; ++i) {
+				Mesh &mesh = parsed->meshes[i].second;
+				set_elements(&mesh, elements[i], parsed->index_data.size, mesh.count);
+				check_indices(parsed->index_data.data + mesh.index_start, mesh.index_type, mesh.index_count, mesh.count);
+				mesh.base_vertex = mesh.start;
+			}
+		}
+
+		//bounding volumes -- from the bnd0 chunk if there is one, otherwise computed here (on the loading thread):
+		if (file.peek_magic() == "bnd0") {
+			ChunkView< MeshBounds > bounds = file.read< MeshBounds >("bnd0");
+			if (bounds.size != parsed->meshes.size()) {
+				throw std::runtime_error("bnd0 chunk in '" + filename + "' doesn't have one entry per mesh");
+			}
+			for (uint32_t i = 0; i < bounds.size; ++i) {
+				parsed->meshes[i].second.bounds = bounds[i];
+			}
+		} else {
+			for (auto &name_mesh : parsed->meshes) {
+				Mesh &mesh = name_mesh.second;
+				if (mesh.compact) {
+					mesh.bounds = bounds_of_box(mesh.dequantize_offset, mesh.dequantize_offset + mesh.dequantize_scale);
+				} else {
+					mesh.bounds = compute_bounds(parsed->vertex_data.data + size_t(mesh.start) * sizeof(v3n3c3), sizeof(v3n3c3), mesh.count);
+				}
+			}
+		}
+
+		//optional name lookup table:
+		if (file.peek_magic() == "phf0") {
+			ChunkView< uint32_t > hash = file.read< uint32_t >("phf0");
+			parsed->hash.from_chunk(hash.data, hash.size, uint32_t(parsed->meshes.size()));
+		}
+
+		if (!file.at_end()) {
+			std::cerr << "WARNING: trailing data in mesh file '" + filename + "'" << std::endl;
+		}
+		return parsed;
+	}
+
+	std::vector< std::string > names_of(Meshes::Parsed const &parsed) {
+		std::vector< std::string > names;
+		names.reserve(parsed.meshes.size());
+		for (auto const &name_mesh : parsed.meshes) {
+			names.emplace_back(name_mesh.first);
+		}
+		return names;
+	}
+}
+
+void Meshes::load(std::string const &filename, Attributes const &attributes, LoadMode mode) {
+	std::unique_ptr< ChunkFile > file(new ChunkFile(filename));
+
+	if (mode == LoadMode::Lazy) {
+		if (file->peek_magic() == "toc0") {
+			std::shared_ptr< Library > library = std::make_shared< Library >();
+			library->file = std::move(file);
+			library->attributes = attributes;
+			load_lazy(library, filename);
+			return;
+		}
+		std::cerr << "WARNING: mesh file '" + filename + "' has no toc0 chunk; loading all meshes now." << std::endl;
+	}
+
+	std::shared_ptr< Parsed > parsed = parse_file(std::move(file), filename);
+	warn_unused_attributes(filename, parsed->compact, attributes);
+
+	MeshId first = add_names(names_of(*parsed), std::move(parsed->hash), filename);
+
+	//upload data (straight from the mapped file) into the shared arenas:
+	VertexArena &arena = arena_for(parsed->compact, attributes);
+	size_t vertex_base = allocate(&files.back(), &arena.vertices, parsed->vertex_data.size);
+	size_t index_base = allocate(&files.back(), &index_arena, parsed->index_data.size);
+	arena.vertices.upload(vertex_base, parsed->vertex_data.data, parsed->vertex_data.size);
+	index_arena.upload(index_base, parsed->index_data.data, parsed->index_data.size);
+	bind_arenas();
+
+	for (uint32_t i = 0; i < parsed->meshes.size(); ++i) {
+		Entry &entry = entries[first + i];
+		entry.mesh = parsed->meshes[i].second;
+		place(&entry.mesh, arena, vertex_base, index_base);
+	}
+}
+
+Meshes::VertexArena::VertexArena(bool compact_, Attributes const &attributes_) : compact(compact_), attributes(attributes_),
+	vertices(compact ? sizeof(q3n2c4) : sizeof(v3n3c3), (4 * 1024 * 1024) / (compact ? sizeof(q3n2c4) : sizeof(v3n3c3))) {
+	glGenVertexArrays(1, &vao);
+}
+
+Meshes::VertexArena &Meshes::arena_for(bool compact, Attributes const &attributes) {
+	for (auto const &arena : vertex_arenas) {
+		if (arena->compact == compact
+			&& arena->attributes.Position == attributes.Position
+			&& arena->attributes.Normal == attributes.Normal
+			&& arena->attributes.Color == attributes.Color
+			&& arena->attributes.NormalOct == attributes.NormalOct) {
+			return *arena;
+		}
+	}
+	vertex_arenas.emplace_back(new VertexArena(compact, attributes));
+	return *vertex_arenas.back();
+}
+
+void Meshes::bind_arenas() {
+	for (auto const &arena : vertex_arenas) {
+		if (arena->bound_vertices == arena->vertices.buffer && arena->bound_indices == index_arena.buffer) continue;
+		glBindVertexArray(arena->vao);
+		if (arena->bound_vertices != arena->vertices.buffer) {
+			glBindBuffer(GL_ARRAY_BUFFER, arena->vertices.buffer);
+			set_attributes(arena->compact, arena->attributes);
+			arena->bound_vertices = arena->vertices.buffer;
+		}
+		if (arena->bound_indices != index_arena.buffer) {
+			//element buffer binding is part of VAO state:
+			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, index_arena.buffer);
+			arena->bound_indices = index_arena.buffer;
+		}
+		glBindVertexArray(0);
+	}
+}
+
+size_t Meshes::allocate(LoadedFile *file, BufferArena *arena, size_t bytes) {
+	if (bytes == 0) return 0;
+	Range range;
+	range.arena = arena;
+	range.count = (bytes + arena->unit - 1) / arena->unit;
+	//growing deletes the arena's old buffer, which would detach it from whatever VAO is bound (likely the
+	// last one Scene::render drew with); other VAOs hold on to it until bind_arenas() moves them over:
+	glBindVertexArray(0);
+	range.offset = arena->allocate(range.count);
+	file->ranges.emplace_back(range);
+	return range.offset * arena->unit;
+}
+
+Meshes::LoadedFile &Meshes::file_of(MeshId id) {
+	for (auto &file : files) {
+		if (file.first <= id && id < file.first + file.ends.size()) return file;
+	}
+	throw std::runtime_error("Mesh doesn't belong to a loaded file.");
+}
+
+void Meshes::unload(std::string const &filename) {
+	//stop any background loads of the file:
+	for (auto li = loading.begin(); li != loading.end(); /* later */) {
+		if ((*li)->filename == filename) {
+			(*li)->parsed.reset();
+			(*li)->error = "unloaded";
+			(*li)->done = true;
+			li = loading.erase(li);
+		} else {
+			++li;
+		}
+	}
+
+	bool found = false;
+	for (auto fi = files.begin(); fi != files.end(); /* later */) {
+		if (fi->filename != filename) {
+			++fi;
+			continue;
+		}
+		found = true;
+		for (auto const &range : fi->ranges) {
+			range.arena->free(range.offset, range.count);
+		}
+		for (MeshId id = fi->first; id < fi->first + fi->ends.size(); ++id) {
+			entries[id] = Entry();
+			entries[id].state = Entry::Unloaded;
+		}
+		fi = files.erase(fi);
+	}
+	if (!found) {
+		std::cerr << "WARNING: unloading mesh file '" + filename + "', which isn't loaded." << std::endl;
+	}
+}
+
+MeshId Meshes::add_names(std::vector< std::string > const &names, PerfectHash &&hash, std::string const &filename) {
+	LoadedFile file;
+	file.filename = filename;
+	file.first = MeshId(entries.size());
+	file.ends.reserve(names.size());
+	for (auto const &name : names) {
+		file.names += name;
+		file.ends.emplace_back(uint32_t(file.names.size()));
+	}
+
+	//use the cooked hash only if it really finds every name:
+	auto finds_all = [&names](PerfectHash const &hash) {
+		for (uint32_t i = 0; i < names.size(); ++i) {
+			uint32_t slot = hash.lookup(names[i].c_str(), names[i].size());
+			if (slot == -1U || names[slot] != names[i]) return false;
+		}
+		return true;
+	};
+	file.hash = std::move(hash);
+	if (!names.empty() && !finds_all(file.hash)) {
+		if (!file.hash.slots.empty()) {
+			std::cerr << "WARNING: phf0 chunk in '" + filename + "' doesn't match its mesh names; rebuilding." << std::endl;
+		}
+		file.hash.build(names);
+	}
+
+	//names already in an earlier file (or earlier in this one) can't be looked up:
+	for (uint32_t i = 0; i < names.size(); ++i) {
+		if (lookup(names[i]) != -1U || file.hash.lookup(names[i].c_str(), names[i].size()) != i) {
+			std::cerr << "WARNING: mesh name '" + names[i] + "' in filename '" + filename + "' collides with existing mesh." << std::endl;
+		}
+	}
+
+	files.emplace_back(std::move(file));
+	entries.resize(entries.size() + names.size());
+	return files.back().first;
+}
+
+MeshId Meshes::lookup(char const *name, size_t length) const {
+	for (auto const &file : files) {
+		uint32_t i = file.hash.lookup(name, length);
+		if (i == -1U) continue;
+		uint32_t begin = (i == 0 ? 0 : file.ends[i-1]);
+		if (file.ends[i] - begin == length && std::memcmp(file.names.data() + begin, name, length) == 0) {
+			return file.first + i;
+		}
+	}
+	return -1U;
+}
+
+std::shared_ptr< Meshes::AsyncLoad const > Meshes::load_async(std::string const &filename, Attributes const &attributes) {
+	std::shared_ptr< AsyncLoad > load = std::make_shared< AsyncLoad >();
+	load->filename = filename;
+	load->attributes = attributes;
+	load->parsing = std::async(std::launch::async, [filename]() -> std::shared_ptr< Parsed > {
+		std::unique_ptr< ChunkFile > file(new ChunkFile(filename));
+		std::shared_ptr< Parsed > parsed = parse_file(std::move(file), filename);
+		//fault the data in here, so the GL thread's uploads don't wait on the disk:
+		volatile char sum = 0;
+		for (size_t i = 0; i < parsed->vertex_data.size; i += 4096) sum += parsed->vertex_data.data[i];
+		for (size_t i = 0; i < parsed->index_data.size; i += 4096) sum += parsed->index_data.data[i];
+		(void)sum;
+		return parsed;
+	});
+	loading.emplace_back(load);
+	return load;
+}
+
+void Meshes::update_uploads(size_t byte_budget) {
+	for (auto li = loading.begin(); li != loading.end(); /* later */) {
+		AsyncLoad &load = **li;
+
+		if (!load.parsed) {
+			//waiting on the worker thread:
+			if (load.parsing.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+				++li;
+				continue;
+			}
+			try {
+				load.parsed = load.parsing.get();
+			} catch (std::exception &e) {
+				load.error = e.what();
+				load.done = true;
+				std::cerr << "ERROR: failed to load mesh file '" << load.filename << "': " << load.error << std::endl;
+				li = loading.erase(li);
+				continue;
+			}
+			warn_unused_attributes(load.filename, load.parsed->compact, load.attributes);
+			load.first = add_names(names_of(*load.parsed), std::move(load.parsed->hash), load.filename);
+			for (uint32_t i = 0; i < load.parsed->meshes.size(); ++i) {
+				entries[load.first + i].state = Entry::Streaming;
+			}
+			//allocate arena space, to be filled over the next few calls:
+			load.arena = &arena_for(load.parsed->compact, load.attributes);
+			load.vertex_base = allocate(&files.back(), &load.arena->vertices, load.parsed->vertex_data.size);
+			load.index_base = allocate(&files.back(), &index_arena, load.parsed->index_data.size);
+			//(now, not once the upload is done, so meshes already Ready keep drawing from the grown arenas)
+			bind_arenas();
+		}
+
+		//upload a slice of whatever remains:
+		auto upload_slice = [&byte_budget](BufferArena &arena, size_t base, ChunkView< char > const &data, size_t *_uploaded) {
+			size_t &uploaded = *_uploaded;
+			size_t amount = std::min(byte_budget, data.size - uploaded);
+			if (amount == 0) return;
+			arena.upload(base + uploaded, data.data + uploaded, amount);
+			uploaded += amount;
+			byte_budget -= amount;
+		};
+		upload_slice(load.arena->vertices, load.vertex_base, load.parsed->vertex_data, &load.vertex_uploaded);
+		upload_slice(index_arena, load.index_base, load.parsed->index_data, &load.index_uploaded);
+
+		if (load.vertex_uploaded == load.parsed->vertex_data.size && load.index_uploaded == load.parsed->index_data.size) {
+			for (uint32_t i = 0; i < load.parsed->meshes.size(); ++i) {
+				Entry &entry = entries[load.first + i];
+				entry.state = Entry::Ready;
+				entry.mesh = load.parsed->meshes[i].second;
+				place(&entry.mesh, *load.arena, load.vertex_base, load.index_base);
 			}
+			load.parsed.reset(); //unmaps the file
+			load.done = true;
+			li = loading.erase(li);
+		} else {
+			++li;
 		}
+		if (byte_budget == 0) break;
+	}
+}
+
+Meshes::Status Meshes::status(std::string const &name) const {
+	MeshId id = lookup(name);
+	if (id != -1U) {
+		return (entries[id].state == Entry::Streaming ? Status::Loading : Status::Ready);
+	}
+	//a load whose directory hasn't been read yet might contain any name:
+	for (auto const &load : loading) {
+		if (!load->parsed) return Status::Loading;
+	}
+	return Status::Missing;
+}
+
+void Meshes::load_lazy(std::shared_ptr< Library > const &library, std::string const &filename) {
+	ChunkFile &file = *library->file;
+
+	//the toc0 chunk is a header, followed by chunk entries, followed by mesh entries:
+	ChunkView< char > toc = file.read< char >("toc0");
+	TocHeader header;
+	if (toc.size < sizeof(TocHeader)) {
+		throw std::runtime_error("toc0 chunk is too small for its header");
+	}
+	std::memcpy(&header, toc.data, sizeof(TocHeader));
+	if (toc.size != sizeof(TocHeader) + size_t(header.chunk_count) * sizeof(TocChunk) + size_t(header.mesh_count) * sizeof(TocMesh)) {
+		throw std::runtime_error("toc0 chunk size doesn't match its entry counts");
+	}
+	ChunkView< TocChunk > chunks = file.view< TocChunk >(
+		(toc.data - file.base) + sizeof(TocHeader),
+		header.chunk_count * sizeof(TocChunk));
+	ChunkView< TocMesh > toc_meshes = file.view< TocMesh >(
+		(toc.data - file.base) + sizeof(TocHeader) + header.chunk_count * sizeof(TocChunk),
+		header.mesh_count * sizeof(TocMesh));
+
+	//find the chunks that meshes refer into:
+	TocChunk const *data_chunk = nullptr;
+	TocChunk const *strings_chunk = nullptr;
+	TocChunk const *compact_index_chunk = nullptr;
+	TocChunk const *index_data_chunk = nullptr;
+	TocChunk const *elements_chunk = nullptr;
+	TocChunk const *bounds_chunk = nullptr;
+	TocChunk const *hash_chunk = nullptr;
+	bool compact = false;
+	for (auto const &chunk : chunks) {
+		std::string magic(chunk.magic, 4);
+		if (magic == "v3n3" || magic == "q3n2") {
+			data_chunk = &chunk;
+			compact = (magic == "q3n2");
+		}
+		if (magic == "str0") strings_chunk = &chunk;
+		if (magic == "idq0") compact_index_chunk = &chunk;
+		if (magic == "ind0") index_data_chunk = &chunk;
+		if (magic == "elm0") elements_chunk = &chunk;
+		if (magic == "bnd0") bounds_chunk = &chunk;
+		if (magic == "phf0") hash_chunk = &chunk;
+	}
+	if (!data_chunk || !strings_chunk || (compact && !compact_index_chunk)) {
+		throw std::runtime_error("toc0 chunk in '" + filename + "' doesn't list data, str0 (and, if compact, idq0) chunks");
+	}
+	warn_unused_attributes(filename, compact, library->attributes);
+
+	ChunkView< char > strings = file.read_at< char >(strings_chunk->offset, "str0");
+	uint32_t data_begin = data_chunk->offset + 8; //skip chunk header
+	uint32_t data_end = data_begin + data_chunk->size;
+	size_t vertex_size = (compact ? sizeof(q3n2c4) : sizeof(v3n3c3));
+
+	//compact meshes need their bounding boxes, which live in the (small) idq0 chunk:
+	ChunkView< CompactIndexEntry > compact_index;
+	if (compact) {
+		compact_index = file.read_at< CompactIndexEntry >(compact_index_chunk->offset, "idq0");
+		if (compact_index.size != toc_meshes.size) {
+			throw std::runtime_error("idq0 chunk in '" + filename + "' doesn't match toc0 mesh entries");
+		}
+	}
+
+	//indexed meshes need their index ranges, from the (small) elm0 chunk:
+	ChunkView< ElementEntry > elements;
+	uint32_t index_data_begin = 0;
+	if (index_data_chunk && elements_chunk) {
+		elements = file.read_at< ElementEntry >(elements_chunk->offset, "elm0");
+		if (elements.size != toc_meshes.size) {
+			throw std::runtime_error("elm0 chunk in '" + filename + "' doesn't match toc0 mesh entries");
+		}
+		index_data_begin = index_data_chunk->offset + 8; //skip chunk header
 	}
 
-	if (file.peek() != EOF) {
-		std::cerr << "WARNING: trailing data in mesh file '" + filename + "'" << std::endl;
+	//bounding volumes, from the (small) bnd0 chunk (otherwise computed when each mesh is uploaded):
+	ChunkView< MeshBounds > bounds;
+	if (bounds_chunk) {
+		bounds = file.read_at< MeshBounds >(bounds_chunk->offset, "bnd0");
+		if (bounds.size != toc_meshes.size) {
+			throw std::runtime_error("bnd0 chunk in '" + filename + "' doesn't match toc0 mesh entries");
+		}
+	}
+
+	//check (and fill in) every entry before registering any names, so a bad toc leaves nothing behind:
+	std::vector< Entry > loaded(toc_meshes.size);
+	for (uint32_t i = 0; i < toc_meshes.size; ++i) {
+		TocMesh const &toc_mesh = toc_meshes[i];
+		if (!(toc_mesh.size == toc_mesh.vertex_count * vertex_size && data_begin <= toc_mesh.offset && toc_mesh.offset <= data_end && toc_mesh.size <= data_end - toc_mesh.offset)) {
+			throw std::runtime_error("toc entry has out-of-range vertex offset/size");
+		}
+		Entry &entry = loaded[i];
+		entry.state = Entry::Pending;
+		entry.library = library;
+		entry.offset = toc_mesh.offset;
+		entry.count = toc_mesh.vertex_count;
+		if (compact) set_dequantize(&entry.mesh, compact_index[i].min, compact_index[i].max);
+		if (!bounds.empty()) {
+			entry.mesh.bounds = bounds[i];
+		} else if (compact) {
+			entry.mesh.bounds = bounds_of_box(compact_index[i].min, compact_index[i].max);
+		} else {
+			entry.needs_bounds = true;
+		}
+		if (!elements.empty()) {
+			set_elements(&entry.mesh, elements[i], index_data_chunk->size, toc_mesh.vertex_count);
+			entry.index_offset = index_data_begin + entry.mesh.index_start;
+			entry.mesh.index_start = 0; //(set when the mesh's indices are placed in the index arena)
+		}
+	}
+
+	std::vector< std::string > names;
+	names.reserve(toc_meshes.size);
+	for (auto const &entry : toc_meshes) {
+		if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size)) {
+			throw std::runtime_error("toc entry has out-of-range name begin/end");
+		}
+		names.emplace_back(strings.data + entry.name_begin, strings.data + entry.name_end);
+	}
+	PerfectHash hash;
+	if (hash_chunk) {
+		ChunkView< uint32_t > data = file.read_at< uint32_t >(hash_chunk->offset, "phf0");
+		hash.from_chunk(data.data, data.size, toc_meshes.size);
+	}
+	MeshId first = add_names(names, std::move(hash), filename);
+
+	for (uint32_t i = 0; i < loaded.size(); ++i) {
+		entries[first + i] = std::move(loaded[i]);
 	}
 }
 
-Mesh const &Meshes::get(std::string const &name) const {
-	auto f = meshes.find(name);
-	if (f == meshes.end()) {
+Mesh const &Meshes::get(MeshId id) {
+	if (id >= entries.size()) {
 		throw std::runtime_error("Looking up mesh that doesn't exist.");
 	}
-	return f->second;
+	Entry &entry = entries[id];
+	if (entry.state == Entry::Streaming) {
+		throw std::runtime_error("Looking up mesh that isn't done loading.");
+	}
+	if (entry.state == Entry::Unloaded) {
+		throw std::runtime_error("Looking up mesh that was unloaded.");
+	}
+	if (entry.state == Entry::Pending) {
+		//first use of a lazily-loaded mesh -- read + upload just its vertices (and indices):
+		Library &library = *entry.library;
+		Mesh &mesh = entry.mesh;
+		size_t vertex_size = (mesh.compact ? sizeof(q3n2c4) : sizeof(v3n3c3));
+		ChunkView< char > data = library.file->view< char >(entry.offset, entry.count * vertex_size);
+		ChunkView< char > index_data;
+		if (mesh.index_type != 0) {
+			size_t index_size = (mesh.index_type == GL_UNSIGNED_SHORT ? 2 : 4);
+			index_data = library.file->view< char >(entry.index_offset, mesh.index_count * index_size);
+			//(lazy loads check indices here, on first use, rather than reading every mesh's indices up front)
+			check_indices(index_data.data, mesh.index_type, mesh.index_count, entry.count);
+		}
+		VertexArena &arena = arena_for(mesh.compact, library.attributes);
+		LoadedFile &file = file_of(id);
+		size_t vertex_base = allocate(&file, &arena.vertices, data.size);
+		size_t index_base = allocate(&file, &index_arena, index_data.size);
+		arena.vertices.upload(vertex_base, data.data, data.size);
+		index_arena.upload(index_base, index_data.data, index_data.size);
+		bind_arenas();
+		if (entry.needs_bounds) {
+			mesh.bounds = compute_bounds(data.data, sizeof(v3n3c3), entry.count);
+		}
+		mesh.start = 0;
+		mesh.count = entry.count;
+		place(&mesh, arena, vertex_base, index_base);
+		entry.library.reset(); //(file is unmapped once its last pending mesh goes)
+		entry.state = Entry::Ready;
+	}
+	return entry.mesh;
+}
+
+Mesh const &Meshes::get(std::string const &name) {
+	return get(lookup(name));
 }
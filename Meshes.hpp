@@ -1,32 +1,188 @@
 #pragma once
 
 #include "GL.hpp"
-#include <map>
+#include "ChunkFile.hpp"
+#include "PerfectHash.hpp"
+#include "BufferArena.hpp"
+#include "MeshBounds.hpp"
+#include <glm/glm.hpp>
+#include <string>
+#include <memory>
+#include <vector>
+#include <future>
 
 //Mesh is a lightweight handle to some OpenGL vertex data:
 struct Mesh {
 	GLuint vao = 0;
 	GLuint start = 0;
 	GLuint count = 0;
+	//indexed meshes draw 'index_count' indices starting at byte 'index_start' of the VAO's element buffer:
+	GLenum index_type = 0; //GL_UNSIGNED_SHORT, GL_UNSIGNED_INT, or 0 for non-indexed (draw 'count' vertices from 'start')
+	GLuint index_start = 0;
+	GLuint index_count = 0;
+	GLint base_vertex = 0; //added to every index
+	//compact (q3n2c4) meshes store positions as [0,1]^3 within their bounding box
+	// and normals octahedral-encoded; draw them with a program that reads NormalOct:
+	bool compact = false;
+	glm::vec3 dequantize_offset = glm::vec3(0.0f); //position = offset + scale * stored position
+	glm::vec3 dequantize_scale = glm::vec3(1.0f);
+	//object-space bounding box + sphere (from the bnd0 chunk, or computed at load):
+	MeshBounds bounds;
 };
 
+//MeshId is a dense index for a mesh in a Meshes DB (resolve names once with Meshes::lookup):
+typedef uint32_t MeshId;
+
 //"Meshes" loads a collection of meshes and builds VAOs for 'em
 // you pass in a 'Bindings' object to specify which attributes to bind where
+// all meshes of a format (with the same bindings) share one VAO, sub-allocated from shared buffers
 
 struct Meshes {
 	struct Attributes {
 		GLuint Position = -1U;
 		GLuint Normal = -1U;
 		GLuint Color = -1U;
+		GLuint NormalOct = -1U; //vec2 octahedral normal, used by compact meshes instead of Normal
+	};
+	enum class LoadMode {
+		Eager, //read + upload every mesh during load()
+		Lazy, //register names during load(), read + upload each mesh on its first get() (needs a toc0 chunk)
 	};
 	//add meshes from a file; use the indicated indices for attribute locations:
 	// note: will throw if file fails to read.
-	void load(std::string const &filename, Attributes const &attributes);
+	void load(std::string const &filename, Attributes const &attributes, LoadMode mode = LoadMode::Eager);
+
+	//start loading meshes from a file in the background:
+	// the file is read + validated on a worker thread; GL uploads happen (a slice at a time) in update_uploads().
+	// errors are reported through the returned handle rather than thrown.
+	struct AsyncLoad;
+	std::shared_ptr< AsyncLoad const > load_async(std::string const &filename, Attributes const &attributes);
+
+	//continue background loads; call once per frame from the GL thread:
+	// uploads at most (about) 'byte_budget' bytes of vertex + index data per call.
+	void update_uploads(size_t byte_budget = 4 * 1024 * 1024);
+
+	//remove all meshes loaded from a file, returning their buffer space for reuse by later loads:
+	// their names stop resolving and their ids become invalid; objects drawing them must be removed first.
+	void unload(std::string const &filename);
+
+	//find the id of a mesh by name (a hash and one compare; doesn't allocate):
+	// returns -1U if no mesh by that name has been registered (yet).
+	MeshId lookup(char const *name, size_t length) const;
+	MeshId lookup(std::string const &name) const { return lookup(name.c_str(), name.size()); }
 
 	//look up a particular mesh in the DB:
-	// note: will throw if mesh not found.
-	Mesh const &get(std::string const &name) const;
+	// note: will throw if mesh not found (or not yet loaded).
+	// note: non-const because lazily-loaded meshes are uploaded here.
+	Mesh const &get(MeshId id);
+	Mesh const &get(std::string const &name);
+
+	//look up a mesh that may still be streaming in:
+	enum class Status {
+		Ready, //get() will succeed
+		Loading, //mesh is (or may be) part of a load_async() that hasn't finished
+		Missing, //no such mesh
+	};
+	Status status(std::string const &name) const;
 
 	//internals:
-	std::map< std::string, Mesh > meshes;
+
+	//a lazily-loaded file stays mapped until all of its meshes are uploaded:
+	struct Library {
+		std::unique_ptr< ChunkFile > file;
+		Attributes attributes;
+	};
+
+	//everything known about a mesh, indexed by MeshId:
+	struct Entry {
+		enum State {
+			Ready, //'mesh' is uploaded
+			Pending, //lazily-loaded; vertices are at 'offset' in 'library'
+			Streaming, //part of a load_async() that hasn't finished uploading
+			Unloaded, //removed by unload()
+		} state = Ready;
+		Mesh mesh; //(for Pending meshes: format + dequantization info, filled in ahead of upload)
+		std::shared_ptr< Library > library;
+		uint32_t offset = 0; //byte offset of first vertex in file
+		uint32_t count = 0; //vertex count
+		uint32_t index_offset = 0; //byte offset of first index in file (if indexed)
+		bool needs_bounds = false; //(file has no bnd0 chunk, so compute bounds at upload)
+	};
+	std::vector< Entry > entries;
+
+	//storage shared by every mesh of one vertex format + attribute bindings:
+	struct VertexArena {
+		VertexArena(bool compact, Attributes const &attributes);
+		bool compact;
+		Attributes attributes;
+		BufferArena vertices; //(one unit per vertex)
+		GLuint vao = 0;
+		//buffers 'vao' currently reads from (re-pointed when an arena grows):
+		GLuint bound_vertices = 0;
+		GLuint bound_indices = 0;
+	};
+	std::vector< std::unique_ptr< VertexArena > > vertex_arenas;
+	BufferArena index_arena{4, 1024 * 1024}; //shared by all VAOs (one unit per 4 bytes)
+
+	//find (or create) the arena for a format:
+	VertexArena &arena_for(bool compact, Attributes const &attributes);
+	//re-point VAOs at any arena buffers that grew:
+	void bind_arenas();
+
+	//a range sub-allocated for a file:
+	struct Range {
+		BufferArena *arena;
+		size_t offset, count; //units
+	};
+
+	//the meshes from one file, with ids [first, first + ends.size()):
+	struct LoadedFile {
+		std::string filename;
+		MeshId first = 0;
+		std::string names; //all names, concatenated
+		std::vector< uint32_t > ends; //end of each name in 'names'
+		PerfectHash hash; //name -> index in this file
+		std::vector< Range > ranges; //buffer space used by this file's meshes
+	};
+	std::vector< LoadedFile > files; //in load order; earlier files win name collisions
+
+	//add a file's names to the DB and make (default) entries for them:
+	// uses 'hash' if it is non-empty and valid for the names, otherwise builds one.
+	MeshId add_names(std::vector< std::string > const &names, PerfectHash &&hash, std::string const &filename);
+
+	//the file a mesh was loaded from:
+	LoadedFile &file_of(MeshId id);
+
+	//sub-allocate (at least) 'bytes' bytes for a file's meshes; returns the offset in bytes:
+	size_t allocate(LoadedFile *file, BufferArena *arena, size_t bytes);
+
+	//chunks of a mesh file, validated and ready for upload (produced without touching GL):
+	struct Parsed {
+		std::unique_ptr< ChunkFile > file; //views below point into this file
+		bool compact = false;
+		ChunkView< char > vertex_data;
+		ChunkView< char > index_data; //(empty if not indexed)
+		std::vector< std::pair< std::string, Mesh > > meshes; //(vao not yet filled in)
+		PerfectHash hash; //from phf0 chunk (empty if file doesn't have one)
+	};
+
+	struct AsyncLoad {
+		std::string filename;
+		Attributes attributes;
+		std::future< std::shared_ptr< Parsed > > parsing; //result of worker thread
+		//progress of upload on the GL thread:
+		std::shared_ptr< Parsed > parsed;
+		MeshId first = -1U; //ids of meshes (reserved once parsed)
+		VertexArena *arena = nullptr;
+		size_t vertex_base = 0; //byte offsets of the file's data in the arenas
+		size_t index_base = 0;
+		size_t vertex_uploaded = 0;
+		size_t index_uploaded = 0;
+		//state visible to the caller:
+		bool done = false; //all meshes are available (or loading failed)
+		std::string error; //non-empty if loading failed
+	};
+	std::vector< std::shared_ptr< AsyncLoad > > loading;
+
+	void load_lazy(std::shared_ptr< Library > const &library, std::string const &filename);
 };
@@ -0,0 +1,90 @@
+#include "NameTable.hpp"
+#include "PerfectHash.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+uint32_t NameTable::bucket_of(char const *name, size_t length) const {
+	uint32_t mask = uint32_t(buckets.size()) - 1;
+	uint32_t bucket = uint32_t(PerfectHash::hash(name, length)) & mask;
+	//linear probing (the table is kept at most half full, so an empty bucket is always found):
+	while (buckets[bucket] != -1U) {
+		NameId id = buckets[bucket];
+		if (ends[id] - begins[id] == length && std::memcmp(chars.data() + begins[id], name, length) == 0) break;
+		bucket = (bucket + 1) & mask;
+	}
+	return bucket;
+}
+
+NameId NameTable::insert(uint32_t bucket, uint32_t begin, uint32_t end) {
+	NameId id = NameId(begins.size());
+	begins.emplace_back(begin);
+	ends.emplace_back(end);
+	buckets[bucket] = id;
+	sorted_dirty = true;
+
+	//grow to keep the load factor at or below 1/2:
+	if (2 * begins.size() > buckets.size()) {
+		buckets.assign(buckets.size() * 2, -1U);
+		for (NameId i = 0; i < begins.size(); ++i) {
+			buckets[bucket_of(chars.data() + begins[i], ends[i] - begins[i])] = i;
+		}
+	}
+	return id;
+}
+
+NameId NameTable::intern(char const *name, size_t length) {
+	if (buckets.empty()) buckets.assign(16, -1U);
+	uint32_t bucket = bucket_of(name, length);
+	if (buckets[bucket] != -1U) return buckets[bucket];
+	uint32_t begin = uint32_t(chars.size());
+	chars.append(name, length);
+	return insert(bucket, begin, uint32_t(chars.size()));
+}
+
+uint32_t NameTable::add_strings(char const *data, size_t size) {
+	if (chars.size() + size > 0xffffffffULL) {
+		throw std::runtime_error("NameTable: too many characters");
+	}
+	uint32_t offset = uint32_t(chars.size());
+	chars.append(data, size);
+	return offset;
+}
+
+NameId NameTable::intern_span(uint32_t begin, uint32_t end) {
+	if (!(begin <= end && end <= chars.size())) {
+		throw std::runtime_error("NameTable: span out of range");
+	}
+	if (buckets.empty()) buckets.assign(16, -1U);
+	uint32_t bucket = bucket_of(chars.data() + begin, end - begin);
+	if (buckets[bucket] != -1U) return buckets[bucket];
+	return insert(bucket, begin, end);
+}
+
+NameId NameTable::find(char const *name, size_t length) const {
+	if (buckets.empty()) return -1U;
+	return buckets[bucket_of(name, length)];
+}
+
+void NameTable::find_prefix(char const *prefix, size_t length, std::vector< NameId > *ids) const {
+	if (sorted_dirty) {
+		sorted.resize(begins.size());
+		for (NameId i = 0; i < sorted.size(); ++i) {
+			sorted[i] = i;
+		}
+		std::sort(sorted.begin(), sorted.end(), [this](NameId a, NameId b) {
+			return chars.compare(begins[a], ends[a] - begins[a], chars, begins[b], ends[b] - begins[b]) < 0;
+		});
+		sorted_dirty = false;
+	}
+
+	//names with the prefix are contiguous in sorted order, starting at the first name not less than the prefix:
+	auto begin = std::partition_point(sorted.begin(), sorted.end(), [&](NameId id) {
+		return chars.compare(begins[id], ends[id] - begins[id], prefix, length) < 0;
+	});
+	for (auto i = begin; i != sorted.end(); ++i) {
+		if (ends[*i] - begins[*i] < length || chars.compare(begins[*i], length, prefix, length) != 0) break;
+		ids->emplace_back(*i);
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <cstddef>
+
+//NameId is a dense index for an interned name (-1U for none):
+typedef uint32_t NameId;
+
+//"NameTable" interns strings: each distinct name is stored once (in 'chars') and referred to by a NameId.
+// Finding a name is one hash and (usually) one compare; ids are never invalidated.
+// Names can also be found by prefix, through a sorted index that is rebuilt only after new names are added.
+struct NameTable {
+	//id of 'name', adding it if needed:
+	NameId intern(char const *name, size_t length);
+	NameId intern(std::string const &name) { return intern(name.c_str(), name.size()); }
+
+	//intern every name in a string table (e.g. a blob's str0 chunk), copying its characters once:
+	// returns the offset of the table in 'chars'; afterward intern_span(offset + begin, offset + end) names its entries.
+	uint32_t add_strings(char const *data, size_t size);
+	//id of the name at [begin, end) of 'chars' (reuses those characters if it is a new name):
+	NameId intern_span(uint32_t begin, uint32_t end);
+
+	//id of 'name', or -1U if it was never interned:
+	NameId find(char const *name, size_t length) const;
+	NameId find(std::string const &name) const { return find(name.c_str(), name.size()); }
+
+	//ids of every interned name starting with 'prefix', in sorted order:
+	void find_prefix(char const *prefix, size_t length, std::vector< NameId > *ids) const;
+	void find_prefix(std::string const &prefix, std::vector< NameId > *ids) const { find_prefix(prefix.c_str(), prefix.size(), ids); }
+
+	std::string str(NameId id) const { return std::string(chars.data() + begins[id], chars.data() + ends[id]); }
+	size_t size() const { return begins.size(); }
+
+	//storage:
+	std::string chars; //characters of all names (and of any string tables added)
+	std::vector< uint32_t > begins, ends; //range of each name in 'chars'
+	std::vector< NameId > buckets; //open-addressed hash table of ids (-1U = empty); size is a power of two
+	mutable std::vector< NameId > sorted; //ids in name order (for find_prefix)
+	mutable bool sorted_dirty = false;
+
+	//find the bucket holding 'name' or, if it isn't there, the empty bucket where it would go:
+	uint32_t bucket_of(char const *name, size_t length) const;
+	//add a name whose characters are already in 'chars':
+	NameId insert(uint32_t bucket, uint32_t begin, uint32_t end);
+};
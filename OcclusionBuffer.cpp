@@ -0,0 +1,204 @@
+#include "OcclusionBuffer.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCCLUSION_SSE
+#include <emmintrin.h>
+#endif
+
+const uint32_t OcclusionBuffer::TileWidth;
+const uint32_t OcclusionBuffer::TileHeight;
+
+namespace {
+	const float Infinity = std::numeric_limits< float >::infinity();
+	const float MinW = 1e-5f; //(corners nearer than this are treated as behind the camera)
+
+	//the corners of a box, in the order used by BoxTriangles:
+	void box_corners(glm::vec3 const &min, glm::vec3 const &max, glm::vec4 corners[8]) {
+		for (int i = 0; i < 8; ++i) {
+			corners[i] = glm::vec4((i & 1) ? max.x : min.x, (i & 2) ? max.y : min.y, (i & 4) ? max.z : min.z, 1.0f);
+		}
+	}
+
+	//two triangles per face:
+	const uint8_t BoxTriangles[12][3] = {
+		{0,1,3}, {0,3,2}, {4,6,7}, {4,7,5}, //-z, +z
+		{0,4,5}, {0,5,1}, {2,3,7}, {2,7,6}, //-y, +y
+		{0,2,6}, {0,6,4}, {1,5,7}, {1,7,3}, //-x, +x
+	};
+}
+
+void OcclusionBuffer::clear(uint32_t width_, uint32_t height_) {
+	tiles_x = (width_ + TileWidth - 1) / TileWidth;
+	tiles_y = (height_ + TileHeight - 1) / TileHeight;
+	width = tiles_x * TileWidth;
+	height = tiles_y * TileHeight;
+	depth.assign(size_t(width) * height, Infinity);
+	tile_max.assign(size_t(tiles_x) * tiles_y, Infinity);
+	triangles.clear();
+}
+
+void OcclusionBuffer::add_occluder(glm::mat4 const &to_clip, glm::vec3 const &min, glm::vec3 const &max) {
+	glm::vec4 corners[8];
+	box_corners(min, max, corners);
+	float x[8], y[8], w[8];
+	for (int i = 0; i < 8; ++i) {
+		glm::vec4 clip = to_clip * corners[i];
+		if (clip.w < MinW) return;
+		x[i] = (clip.x / clip.w * 0.5f + 0.5f) * width;
+		y[i] = (clip.y / clip.w * 0.5f + 0.5f) * height;
+		w[i] = clip.w;
+	}
+	for (auto const &indices : BoxTriangles) {
+		Triangle triangle;
+		triangle.w = 0.0f;
+		for (int i = 0; i < 3; ++i) {
+			triangle.x[i] = x[indices[i]];
+			triangle.y[i] = y[indices[i]];
+			triangle.w = std::max(triangle.w, w[indices[i]]);
+		}
+		triangles.emplace_back(triangle);
+	}
+}
+
+void OcclusionBuffer::rasterize(WorkerPool *pool) {
+	if (pool && pool->size() > 1 && tiles_y > 1) {
+		StealingQueues< uint32_t > queues(pool->size());
+		for (uint32_t row = 0; row < tiles_y; ++row) {
+			queues.push(row * pool->size() / tiles_y, row);
+		}
+		pool->run([this, &queues](uint32_t worker) {
+			uint32_t row;
+			while (queues.pop(worker, &row)) {
+				rasterize_band(row);
+			}
+		});
+	} else {
+		for (uint32_t row = 0; row < tiles_y; ++row) {
+			rasterize_band(row);
+		}
+	}
+}
+
+void OcclusionBuffer::rasterize_band(uint32_t tile_row) {
+	float band_y0 = float(tile_row * TileHeight);
+	float band_y1 = band_y0 + TileHeight;
+
+	for (auto const &triangle : triangles) {
+		//bounds of the triangle within this band:
+		float min_y = std::min(triangle.y[0], std::min(triangle.y[1], triangle.y[2]));
+		float max_y = std::max(triangle.y[0], std::max(triangle.y[1], triangle.y[2]));
+		if (max_y <= band_y0 || min_y >= band_y1) continue;
+		float min_x = std::min(triangle.x[0], std::min(triangle.x[1], triangle.x[2]));
+		float max_x = std::max(triangle.x[0], std::max(triangle.x[1], triangle.x[2]));
+		if (max_x <= 0.0f || min_x >= float(width)) continue;
+
+		//edge functions, oriented so the inside is positive:
+		// (pixels are covered if their centers are inside, edges included, so boxes sharing an edge leave no seam)
+		float area = (triangle.x[1] - triangle.x[0]) * (triangle.y[2] - triangle.y[0])
+		           - (triangle.x[2] - triangle.x[0]) * (triangle.y[1] - triangle.y[0]);
+		if (std::abs(area) < 1e-6f) continue;
+		float sign = (area > 0.0f ? 1.0f : -1.0f);
+		float A[3], B[3], C[3];
+		for (int e = 0; e < 3; ++e) {
+			int n = (e + 1) % 3;
+			A[e] = sign * (triangle.y[e] - triangle.y[n]);
+			B[e] = sign * (triangle.x[n] - triangle.x[e]);
+			C[e] = sign * (triangle.x[e] * triangle.y[n] - triangle.x[n] * triangle.y[e]);
+		}
+
+		uint32_t y0 = uint32_t(std::max(min_y, band_y0));
+		uint32_t y1 = uint32_t(std::min(std::ceil(max_y), band_y1));
+		uint32_t x0 = uint32_t(std::max(min_x, 0.0f)) & ~3U; //(4-aligned, for the SSE loop)
+		uint32_t x1 = uint32_t(std::min(std::ceil(max_x), float(width)));
+
+		for (uint32_t y = y0; y < y1; ++y) {
+			float py = y + 0.5f;
+			float *row = &depth[size_t(y) * width];
+#ifdef OCCLUSION_SSE
+			__m128 a[3], row_c[3];
+			for (int e = 0; e < 3; ++e) {
+				a[e] = _mm_set1_ps(A[e]);
+				row_c[e] = _mm_set1_ps(B[e] * py + C[e]);
+			}
+			__m128 zero = _mm_setzero_ps();
+			__m128 w = _mm_set1_ps(triangle.w);
+			for (uint32_t x = x0; x < x1; x += 4) {
+				__m128 px = _mm_add_ps(_mm_set1_ps(float(x)), _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f));
+				__m128 inside = _mm_and_ps(_mm_and_ps(
+					_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a[0], px), row_c[0]), zero),
+					_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a[1], px), row_c[1]), zero)),
+					_mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a[2], px), row_c[2]), zero));
+				__m128 old = _mm_loadu_ps(row + x);
+				__m128 nearer = _mm_min_ps(old, w);
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+			}
+#else
+			for (uint32_t x = x0; x < x1; ++x) {
+				float px = x + 0.5f;
+				bool inside = true;
+				for (int e = 0; e < 3; ++e) {
+					inside = inside && (A[e] * px + B[e] * py + C[e] >= 0.0f);
+				}
+				if (inside) row[x] = std::min(row[x], triangle.w);
+			}
+#endif
+		}
+	}
+
+	//tile level for this band:
+	for (uint32_t tx = 0; tx < tiles_x; ++tx) {
+		float farthest = 0.0f;
+		for (uint32_t y = tile_row * TileHeight; y < (tile_row + 1) * TileHeight; ++y) {
+			float const *row = &depth[size_t(y) * width + tx * TileWidth];
+			for (uint32_t x = 0; x < TileWidth; ++x) {
+				farthest = std::max(farthest, row[x]);
+			}
+		}
+		tile_max[tile_row * tiles_x + tx] = farthest;
+	}
+}
+
+bool OcclusionBuffer::test_box(glm::mat4 const &to_clip, glm::vec3 const &min, glm::vec3 const &max) const {
+	glm::vec4 corners[8];
+	box_corners(min, max, corners);
+	float min_x = Infinity, min_y = Infinity, max_x = -Infinity, max_y = -Infinity;
+	float nearest = Infinity;
+	for (int i = 0; i < 8; ++i) {
+		glm::vec4 clip = to_clip * corners[i];
+		if (clip.w < MinW) return true; //(reaches behind the camera)
+		float x = (clip.x / clip.w * 0.5f + 0.5f) * width;
+		float y = (clip.y / clip.w * 0.5f + 0.5f) * height;
+		min_x = std::min(min_x, x);
+		max_x = std::max(max_x, x);
+		min_y = std::min(min_y, y);
+		max_y = std::max(max_y, y);
+		nearest = std::min(nearest, clip.w);
+	}
+
+	//every pixel the box's screen rectangle touches, and one more on each side
+	// (occluders cover pixels whose centers they cover, so can reach up to half a pixel past their silhouettes):
+	uint32_t x0 = uint32_t(std::max(std::floor(min_x) - 1.0f, 0.0f));
+	uint32_t y0 = uint32_t(std::max(std::floor(min_y) - 1.0f, 0.0f));
+	uint32_t x1 = uint32_t(std::min(std::max(std::ceil(max_x) + 1.0f, 0.0f), float(width)));
+	uint32_t y1 = uint32_t(std::min(std::max(std::ceil(max_y) + 1.0f, 0.0f), float(height)));
+	if (x0 >= x1 || y0 >= y1) return true; //(off screen -- that's for frustum culling to decide)
+
+	for (uint32_t ty = y0 / TileHeight; ty * TileHeight < y1; ++ty) {
+		for (uint32_t tx = x0 / TileWidth; tx * TileWidth < x1; ++tx) {
+			if (tile_max[ty * tiles_x + tx] <= nearest) continue; //(every occluder in the tile is in front)
+			uint32_t px0 = std::max(x0, tx * TileWidth), px1 = std::min(x1, (tx + 1) * TileWidth);
+			uint32_t py0 = std::max(y0, ty * TileHeight), py1 = std::min(y1, (ty + 1) * TileHeight);
+			for (uint32_t y = py0; y < py1; ++y) {
+				float const *row = &depth[size_t(y) * width];
+				for (uint32_t x = px0; x < px1; ++x) {
+					if (row[x] > nearest) return true;
+				}
+			}
+		}
+	}
+	return false;
+}
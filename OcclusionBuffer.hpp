@@ -0,0 +1,48 @@
+#pragma once
+
+#include "WorkerPool.hpp"
+
+#include <glm/glm.hpp>
+
+#include <vector>
+#include <stdint.h>
+
+//"OcclusionBuffer" is a small CPU depth buffer for occlusion culling:
+// solid boxes (occluders) are rasterized into it, then other boxes are tested against it.
+// Depth is clip-space w (view distance); each pixel keeps the nearest occluder depth, and each
+// 8x8 tile keeps its farthest pixel, so most tests are settled a tile at a time.
+// Tests are conservative: occluders are treated as lying at their triangles' farthest depth, tested boxes
+// at their nearest corner, and tested boxes are grown by a pixel to make up for occluders being rasterized at
+// pixel centers. (So the only error is that gaps between occluders narrower than a buffer pixel may be closed.)
+struct OcclusionBuffer {
+	static const uint32_t TileWidth = 8;
+	static const uint32_t TileHeight = 8;
+
+	//empty the buffer, resizing it to (at least) width x height (rounded up to whole tiles):
+	void clear(uint32_t width, uint32_t height);
+
+	//queue the box [min, max] (in the space 'to_clip' transforms from) for rasterize():
+	// boxes reaching behind the near plane are skipped (which only means less gets culled).
+	void add_occluder(glm::mat4 const &to_clip, glm::vec3 const &min, glm::vec3 const &max);
+
+	//rasterize queued occluders (one task per row of tiles, spread across 'pool' if given) and build the tile level:
+	void rasterize(WorkerPool *pool = nullptr);
+
+	//false if the box [min, max] is certainly hidden behind occluders:
+	bool test_box(glm::mat4 const &to_clip, glm::vec3 const &min, glm::vec3 const &max) const;
+
+	//storage:
+	uint32_t width = 0, height = 0; //(multiples of the tile size)
+	uint32_t tiles_x = 0, tiles_y = 0;
+	std::vector< float > depth; //per pixel, row-major (infinity where no occluder covers it)
+	std::vector< float > tile_max; //farthest depth in each tile, row-major
+
+	//queued occluder triangles, in pixel coordinates:
+	struct Triangle {
+		float x[3], y[3];
+		float w; //farthest depth of the three corners
+	};
+	std::vector< Triangle > triangles;
+
+	void rasterize_band(uint32_t tile_row);
+};
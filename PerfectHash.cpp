@@ -0,0 +1,127 @@
+#include "PerfectHash.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <unordered_set>
+
+namespace {
+	uint32_t bucket_of(uint64_t h, uint32_t bucket_count) { return uint32_t(h >> 40) % bucket_count; }
+	uint32_t f1(uint64_t h) { return uint32_t(h); }
+	uint32_t f2(uint64_t h) { return uint32_t(h >> 20) | 1; }
+	uint32_t slot_of(uint64_t h, uint32_t displacement, uint32_t slot_count) {
+		return (f1(h) + displacement * f2(h)) % slot_count;
+	}
+}
+
+uint64_t PerfectHash::hash(char const *key, size_t length) {
+	//FNV-1a, then murmur3's finalizer so all bits depend on all bytes:
+	uint64_t h = 14695981039346656037ULL;
+	for (size_t i = 0; i < length; ++i) {
+		h = (h ^ uint8_t(key[i])) * 1099511628211ULL;
+	}
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+void PerfectHash::build(std::vector< std::string > const &all_keys) {
+	displacements.clear();
+	slots.clear();
+
+	//only the first occurrence of each key gets a slot:
+	std::vector< uint32_t > unique; //indices into all_keys
+	{
+		std::unordered_set< std::string > seen;
+		for (uint32_t k = 0; k < all_keys.size(); ++k) {
+			if (seen.insert(all_keys[k]).second) unique.emplace_back(k);
+		}
+	}
+	uint32_t n = uint32_t(unique.size());
+	if (n == 0) return;
+
+	std::vector< uint64_t > hashes;
+	hashes.reserve(n);
+	for (uint32_t k : unique) {
+		hashes.emplace_back(hash(all_keys[k].c_str(), all_keys[k].size()));
+	}
+
+	//about two keys per bucket; place the biggest buckets first while slots are plentiful:
+	uint32_t bucket_count = std::max(1U, n / 2);
+	std::vector< std::vector< uint32_t > > buckets(bucket_count);
+	for (uint32_t k = 0; k < n; ++k) {
+		buckets[bucket_of(hashes[k], bucket_count)].emplace_back(k);
+	}
+	std::vector< uint32_t > order(bucket_count);
+	for (uint32_t b = 0; b < bucket_count; ++b) order[b] = b;
+	std::stable_sort(order.begin(), order.end(), [&buckets](uint32_t a, uint32_t b) {
+		return buckets[a].size() > buckets[b].size();
+	});
+
+	displacements.assign(bucket_count, 0);
+	slots.assign(n, -1U);
+	std::vector< uint32_t > tried;
+	for (uint32_t b : order) {
+		auto const &bucket = buckets[b];
+		if (bucket.empty()) break;
+		for (uint32_t d = 0; ; ++d) {
+			if (d == 1U << 24) {
+				throw std::runtime_error("Failed to build perfect hash");
+			}
+			tried.clear();
+			bool ok = true;
+			for (uint32_t k : bucket) {
+				uint32_t s = slot_of(hashes[k], d, n);
+				if (slots[s] != -1U || std::find(tried.begin(), tried.end(), s) != tried.end()) {
+					ok = false;
+					break;
+				}
+				tried.emplace_back(s);
+			}
+			if (!ok) continue;
+			for (uint32_t i = 0; i < bucket.size(); ++i) {
+				slots[tried[i]] = unique[bucket[i]];
+			}
+			displacements[b] = d;
+			break;
+		}
+	}
+}
+
+uint32_t PerfectHash::lookup(char const *key, size_t length) const {
+	if (slots.empty()) return -1U;
+	uint64_t h = hash(key, length);
+	uint32_t d = displacements[bucket_of(h, uint32_t(displacements.size()))];
+	return slots[slot_of(h, d, uint32_t(slots.size()))];
+}
+
+std::vector< uint32_t > PerfectHash::to_chunk() const {
+	std::vector< uint32_t > chunk;
+	chunk.reserve(2 + displacements.size() + slots.size());
+	chunk.emplace_back(uint32_t(slots.size()));
+	chunk.emplace_back(uint32_t(displacements.size()));
+	chunk.insert(chunk.end(), displacements.begin(), displacements.end());
+	chunk.insert(chunk.end(), slots.begin(), slots.end());
+	return chunk;
+}
+
+void PerfectHash::from_chunk(uint32_t const *data, size_t size, uint32_t key_count) {
+	if (size < 2) {
+		throw std::runtime_error("phf0 chunk is too small for its header");
+	}
+	uint32_t n = data[0];
+	uint32_t bucket_count = data[1];
+	if (n > key_count) {
+		throw std::runtime_error("phf0 chunk has more slots than keys");
+	}
+	if (size != 2 + size_t(bucket_count) + n || (n != 0 && bucket_count == 0)) {
+		throw std::runtime_error("phf0 chunk size doesn't match its counts");
+	}
+	displacements.assign(data + 2, data + 2 + bucket_count);
+	slots.assign(data + 2 + bucket_count, data + 2 + bucket_count + n);
+	for (uint32_t s : slots) {
+		if (s >= key_count) throw std::runtime_error("phf0 chunk has out-of-range slot");
+	}
+}
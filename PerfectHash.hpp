@@ -0,0 +1,30 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <stdint.h>
+#include <cstddef>
+
+//"PerfectHash" maps each of a fixed set of n distinct strings to a distinct slot in [0,n) (hash-and-displace):
+//  h = hash(key); bucket = bucket_of(h); slot = (f1(h) + displacements[bucket] * f2(h)) % n
+// so a lookup is one string hash, two array reads, and (by the caller) one compare.
+// stored in blobs as a "phf0" chunk of uint32s: [n, bucket count, displacements..., slots...]
+struct PerfectHash {
+	std::vector< uint32_t > displacements; //per bucket
+	std::vector< uint32_t > slots; //slot -> key index
+
+	//build for some keys; slots hold indices into 'keys':
+	// (if a key repeats, only its first occurrence is reachable)
+	void build(std::vector< std::string > const &keys);
+
+	//index of the key that 'key' would be, if it is one of the keys (caller must compare):
+	// returns -1U if the table is empty.
+	uint32_t lookup(char const *key, size_t length) const;
+
+	//serialize/deserialize as a phf0 chunk:
+	std::vector< uint32_t > to_chunk() const;
+	// note: will throw if chunk is malformed or refers past 'key_count' keys.
+	void from_chunk(uint32_t const *data, size_t size, uint32_t key_count);
+
+	static uint64_t hash(char const *key, size_t length);
+};
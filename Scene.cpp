@@ -1,62 +1,187 @@
 #include "Scene.hpp"
+#include "ChunkFile.hpp"
 
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <cstddef>
+#include <cstring>
 #include <iostream>
+#include <stdexcept>
 
-glm::mat4 Scene::Transform::make_local_to_parent() const {
-	return glm::mat4( //translate
-		glm::vec4(1.0f, 0.0f, 0.0f, 0.0f),
-		glm::vec4(0.0f, 1.0f, 0.0f, 0.0f),
-		glm::vec4(0.0f, 0.0f, 1.0f, 0.0f),
-		glm::vec4(position, 1.0f)
-	)
-	* glm::mat4_cast(rotation) //rotate
-	* glm::mat4( //scale
-		glm::vec4(scale.x, 0.0f, 0.0f, 0.0f),
-		glm::vec4(0.0f, scale.y, 0.0f, 0.0f),
-		glm::vec4(0.0f, 0.0f, scale.z, 0.0f),
-		glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)
-	);
-}
-
-glm::mat4 Scene::Transform::make_parent_to_local() const {
-	glm::vec3 inv_scale;
-	inv_scale.x = (scale.x == 0.0f ? 0.0f : 1.0f / scale.x);
-	inv_scale.y = (scale.y == 0.0f ? 0.0f : 1.0f / scale.y);
-	inv_scale.z = (scale.z == 0.0f ? 0.0f : 1.0f / scale.z);
-	return glm::mat4( //un-scale
-		glm::vec4(inv_scale.x, 0.0f, 0.0f, 0.0f),
-		glm::vec4(0.0f, inv_scale.y, 0.0f, 0.0f),
-		glm::vec4(0.0f, 0.0f, inv_scale.z, 0.0f),
-		glm::vec4(0.0f, 0.0f, 0.0f, 1.0f)
-	)
-	* glm::mat4_cast(glm::inverse(rotation)) //un-rotate
-	* glm::mat4( //un-translate
-		glm::vec4(1.0f, 0.0f, 0.0f, 0.0f),
-		glm::vec4(0.0f, 1.0f, 0.0f, 0.0f),
-		glm::vec4(0.0f, 0.0f, 1.0f, 0.0f),
-		glm::vec4(-position, 1.0f)
-	);
-}
-
-glm::mat4 Scene::Transform::make_local_to_world() const {
-	if (parent) {
-		return parent->make_local_to_world() * make_local_to_parent();
-	} else {
-		return make_local_to_parent();
+Affine Scene::Transform::make_local_to_parent() const {
+	return Affine::trs(position, rotation, scale);
+}
+
+Affine Scene::Transform::make_parent_to_local() const {
+	return Affine::inverse_trs(position, rotation, scale);
+}
+
+Affine const &Scene::Transform::make_local_to_world() const {
+	if (local_to_world_dirty) {
+		uniform_scale = (scale.x == scale.y && scale.y == scale.z);
+		if (parent) {
+			local_to_world = parent->make_local_to_world() * make_local_to_parent();
+			uniform_scale = uniform_scale && parent->uniform_scale;
+		} else {
+			local_to_world = make_local_to_parent();
+		}
+		local_to_world_dirty = false;
 	}
+	return local_to_world;
 }
 
-glm::mat4 Scene::Transform::make_world_to_local() const {
-	if (parent) {
-		return make_parent_to_local() * parent->make_world_to_local();
-	} else {
-		return make_parent_to_local();
+Affine const &Scene::Transform::make_world_to_local() const {
+	if (world_to_local_dirty) {
+		if (parent) {
+			world_to_local = make_parent_to_local() * parent->make_world_to_local();
+		} else {
+			world_to_local = make_parent_to_local();
+		}
+		world_to_local_dirty = false;
+	}
+	return world_to_local;
+}
+
+bool Scene::Transform::has_uniform_scale() const {
+	make_local_to_world();
+	return uniform_scale;
+}
+
+void Scene::Transform::set_position(glm::vec3 const &position_) {
+	position = position_;
+	mark_dirty();
+}
+
+void Scene::Transform::set_rotation(glm::quat const &rotation_) {
+	rotation = rotation_;
+	mark_dirty();
+}
+
+void Scene::Transform::set_scale(glm::vec3 const &scale_) {
+	scale = scale_;
+	mark_dirty();
+}
+
+void Scene::Transform::mark_dirty() {
+	if (local_to_world_dirty && world_to_local_dirty) return; //(descendants are already dirty too)
+	local_to_world_dirty = true;
+	world_to_local_dirty = true;
+	for (Transform *child = last_child; child; child = child->prev_sibling) {
+		child->mark_dirty();
 	}
 }
 
+void Scene::Transform::update_local_to_world(std::vector< Transform const * > const &roots, WorkerPool &pool) {
+	uint32_t workers = pool.size();
+
+	if (roots.size() >= 8 * size_t(workers)) {
+		//plenty of independent root subtrees -- one task per subtree, handed out in contiguous blocks:
+		StealingQueues< Transform const * > queues(workers);
+		for (size_t i = 0; i < roots.size(); ++i) {
+			queues.push(uint32_t(i * workers / roots.size()), roots[i]);
+		}
+		pool.run([&queues](uint32_t worker) {
+			std::vector< Transform const * > stack;
+			Transform const *root;
+			while (queues.pop(worker, &root)) {
+				stack.emplace_back(root);
+				while (!stack.empty()) {
+					Transform const *transform = stack.back();
+					stack.pop_back();
+					transform->make_local_to_world();
+					for (Transform const *child = transform->last_child; child; child = child->prev_sibling) {
+						stack.emplace_back(child);
+					}
+				}
+			}
+		});
+		return;
+	}
+
+	//a few wide subtrees -- go one depth level at a time, splitting each level into chunks:
+	// (narrow levels, e.g. long chains, aren't worth waking the pool for)
+	const size_t Chunk = 512;
+	std::vector< Transform const * > level(roots);
+	std::vector< std::vector< Transform const * > > next(workers);
+	auto update_range = [&level, &next](uint32_t worker, size_t begin, size_t end) {
+		for (size_t i = begin; i < end; ++i) {
+			level[i]->make_local_to_world();
+			for (Transform const *child = level[i]->last_child; child; child = child->prev_sibling) {
+				next[worker].emplace_back(child);
+			}
+		}
+	};
+	while (!level.empty()) {
+		if (level.size() < 2 * Chunk || workers == 1) {
+			update_range(0, 0, level.size());
+		} else {
+			size_t chunks = (level.size() + Chunk - 1) / Chunk;
+			StealingQueues< size_t > queues(workers);
+			for (size_t c = 0; c < chunks; ++c) {
+				queues.push(uint32_t(c * workers / chunks), c * Chunk);
+			}
+			pool.run([&](uint32_t worker) {
+				size_t begin;
+				while (queues.pop(worker, &begin)) {
+					update_range(worker, begin, std::min(begin + Chunk, level.size()));
+				}
+			});
+		}
+		level.clear();
+		for (auto &transforms : next) {
+			level.insert(level.end(), transforms.begin(), transforms.end());
+			transforms.clear();
+		}
+	}
+}
+
+Scene::Transform::Transform(Transform &&other) noexcept {
+	take_place_of(other);
+}
+
+Scene::Transform &Scene::Transform::operator=(Transform &&other) noexcept {
+	if (this != &other) {
+		//leave the current hierarchy (as the destructor would), then move in:
+		while (last_child) {
+			last_child->set_parent(nullptr);
+		}
+		if (parent) {
+			set_parent(nullptr);
+		}
+		take_place_of(other);
+	}
+	return *this;
+}
+
+void Scene::Transform::take_place_of(Transform &other) {
+	position = other.position;
+	rotation = other.rotation;
+	scale = other.scale;
+	local_to_world = other.local_to_world;
+	world_to_local = other.world_to_local;
+	uniform_scale = other.uniform_scale;
+	local_to_world_dirty = other.local_to_world_dirty;
+	world_to_local_dirty = other.world_to_local_dirty;
+
+	parent = other.parent;
+	last_child = other.last_child;
+	prev_sibling = other.prev_sibling;
+	next_sibling = other.next_sibling;
+	if (prev_sibling) prev_sibling->next_sibling = this;
+	if (next_sibling) next_sibling->prev_sibling = this;
+	else if (parent) parent->last_child = this;
+	for (Transform *child = last_child; child; child = child->prev_sibling) {
+		child->parent = this;
+	}
+
+	other.parent = other.last_child = other.prev_sibling = other.next_sibling = nullptr;
+	DEBUG_assert_valid_pointers();
+}
+
 void Scene::Transform::DEBUG_assert_valid_pointers() const {
 	if (parent == nullptr) {
 		//if no parent, can't have siblings:
@@ -96,52 +221,703 @@ void Scene::Transform::set_parent(Transform *new_parent, Transform *before) {
 		}
 		if (prev_sibling) prev_sibling->next_sibling = this;
 	}
+	mark_dirty();
 	DEBUG_assert_valid_pointers();
 }
 
 //---------------------------
 
+const uint32_t Scene::InstancesPerBlock;
+const GLuint Scene::InstancesBinding;
+const uint32_t Scene::RingRegions;
+const uint32_t Scene::BoxesPerBlock;
+
+void Scene::update_transforms(WorkerPool &pool) {
+	std::vector< Transform const * > roots;
+	if (!camera.transform.parent) roots.emplace_back(&camera.transform);
+	for (auto const &object : objects) {
+		if (!object.transform.parent) roots.emplace_back(&object.transform);
+	}
+	for (auto const &light : lights) {
+		if (!light.transform.parent) roots.emplace_back(&light.transform);
+	}
+	Transform::update_local_to_world(roots, pool);
+}
+
+void Scene::snapshot(Snapshot &into) const {
+	into.camera_to_world = camera.transform.make_local_to_world();
+	into.world_to_camera = camera.transform.make_world_to_local();
+	into.camera_uniform_scale = camera.transform.has_uniform_scale();
+	into.objects.resize(objects.size());
+	for (uint32_t item = 0; item < objects.size(); ++item) {
+		Object const &object = objects.items[item];
+		Snapshot::ObjectState &state = into.objects[item];
+		state.local_to_world = object.transform.make_local_to_world();
+		state.invisible = object.invisible;
+		state.uniform_scale = object.transform.has_uniform_scale();
+	}
+}
+
+Scene::ObjectHandle Scene::add_object(Meshes &meshes, MeshId id) {
+	Mesh const &mesh = meshes.get(id);
+	ObjectHandle handle = objects.emplace();
+	Object &object = objects[handle];
+	object.mesh = id;
+	object.vao = mesh.vao;
+	object.start = mesh.start;
+	object.count = mesh.count;
+	object.index_type = mesh.index_type;
+	object.index_start = mesh.index_start;
+	object.index_count = mesh.index_count;
+	object.base_vertex = mesh.base_vertex;
+	object.dequantize_offset = mesh.dequantize_offset;
+	object.dequantize_scale = mesh.dequantize_scale;
+	object.bounds = mesh.bounds;
+	object.program = (mesh.compact ? compact_mesh_program : mesh_program);
+	return handle;
+}
+
+void Scene::remove_object(ObjectHandle handle) {
+	set_name(handle, -1U);
+	if (objects[handle].query) free_queries.emplace_back(objects[handle].query);
+	objects.remove(handle);
+}
+
+void Scene::set_name(ObjectHandle handle, NameId name) {
+	Object &object = objects[handle];
+	if (object.name == name) return;
+	if (object.name != -1U) {
+		//unlink from the old name's chain (chains are short -- usually just this object):
+		ObjectHandle *link = &named[object.name];
+		while (*link != handle) {
+			link = &objects[*link].next_named;
+		}
+		*link = object.next_named;
+		object.next_named = ObjectHandle();
+	}
+	object.name = name;
+	if (name != -1U) {
+		if (name >= named.size()) named.resize(names.size());
+		object.next_named = named[name];
+		named[name] = handle;
+	}
+}
+
+Scene::ObjectHandle Scene::find(std::string const &name) const {
+	NameId id = names.find(name);
+	if (id == -1U || id >= named.size()) return ObjectHandle();
+	return named[id];
+}
+
+void Scene::find_prefix(std::string const &prefix, std::vector< ObjectHandle > *found) const {
+	std::vector< NameId > ids;
+	names.find_prefix(prefix, &ids);
+	for (NameId id : ids) {
+		if (id >= named.size()) continue;
+		for (ObjectHandle handle = named[id]; handle != ObjectHandle(); handle = objects[handle].next_named) {
+			found->emplace_back(handle);
+		}
+	}
+}
+
+std::vector< Scene::ObjectHandle > Scene::load(std::string const &filename, Meshes &meshes) {
+	ChunkFile file(filename);
+
+	//read strings chunk:
+	ChunkView< char > strings = file.read< char >("str0");
+
+	//read scene chunk (world-space placement of each object):
+	struct SceneEntry {
+		uint32_t name_begin, name_end;
+		glm::vec3 position;
+		glm::quat rotation;
+		glm::vec3 scale;
+	};
+	static_assert(sizeof(SceneEntry) == 48, "Scene entry should be packed");
+	ChunkView< SceneEntry > entries = file.read< SceneEntry >("scn0");
+
+	//read hierarchy chunk, if present (parent index and parent-relative placement of each object):
+	struct HierarchyEntry {
+		uint32_t parent; //index of parent's scn0 entry, or -1U for none
+		glm::vec3 position;
+		glm::quat rotation;
+		glm::vec3 scale;
+	};
+	static_assert(sizeof(HierarchyEntry) == 44, "Hierarchy entry should be packed");
+	ChunkView< HierarchyEntry > hierarchy;
+	if (file.peek_magic() == "hier") {
+		hierarchy = file.read< HierarchyEntry >("hier");
+		if (hierarchy.size != entries.size) {
+			throw std::runtime_error("Scene '" + filename + "' has " + std::to_string(hierarchy.size) + " hierarchy entries for " + std::to_string(entries.size) + " objects");
+		}
+	}
+
+	//check everything before adding anything:
+	std::vector< MeshId > ids;
+	ids.reserve(entries.size);
+	for (auto const &entry : entries) {
+		if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size)) {
+			throw std::runtime_error("Scene '" + filename + "' has an entry with out-of-range name begin/end");
+		}
+		char const *name = strings.data + entry.name_begin;
+		size_t length = entry.name_end - entry.name_begin;
+		ids.emplace_back(meshes.lookup(name, length));
+		if (ids.back() == -1U) {
+			throw std::runtime_error("Scene '" + filename + "' refers to mesh '" + std::string(name, length) + "', which doesn't exist");
+		}
+	}
+	if (hierarchy.size) {
+		//parents must be in range and acyclic (state: 0 = unchecked, 1 = on the current path, 2 = reaches a root):
+		std::vector< uint8_t > state(hierarchy.size, 0);
+		for (size_t i = 0; i < hierarchy.size; ++i) {
+			uint32_t at = uint32_t(i);
+			while (at != -1U && state[at] == 0) {
+				state[at] = 1;
+				at = hierarchy.data[at].parent;
+				if (at != -1U && at >= hierarchy.size) {
+					throw std::runtime_error("Scene '" + filename + "' has a parent index out of range");
+				}
+			}
+			if (at != -1U && state[at] == 1) {
+				throw std::runtime_error("Scene '" + filename + "' has a cycle in its hierarchy");
+			}
+			for (at = uint32_t(i); at != -1U && state[at] == 1; at = hierarchy.data[at].parent) {
+				state[at] = 2;
+			}
+		}
+	}
+
+	//names are interned from a single copy of the strings chunk:
+	uint32_t strings_offset = names.add_strings(strings.data, strings.size);
+
+	//create all the objects:
+	std::vector< ObjectHandle > handles;
+	handles.reserve(entries.size);
+	objects.reserve(objects.size() + entries.size);
+	for (size_t i = 0; i < entries.size; ++i) {
+		handles.emplace_back(add_object(meshes, ids[i]));
+		Transform &transform = objects[handles.back()].transform;
+		if (hierarchy.size) {
+			transform.position = hierarchy.data[i].position;
+			transform.rotation = hierarchy.data[i].rotation;
+			transform.scale = hierarchy.data[i].scale;
+		} else {
+			transform.position = entries.data[i].position;
+			transform.rotation = entries.data[i].rotation;
+			transform.scale = entries.data[i].scale;
+		}
+		//(new transforms start dirty, so there is no need for mark_dirty)
+		set_name(handles.back(), names.intern_span(strings_offset + entries.data[i].name_begin, strings_offset + entries.data[i].name_end));
+	}
+
+	//link parents by index:
+	// (storage doesn't move from here on, so pointers are safe)
+	for (size_t i = 0; i < hierarchy.size; ++i) {
+		uint32_t parent = hierarchy.data[i].parent;
+		if (parent != -1U) {
+			objects[handles[i]].transform.set_parent(&objects[handles[parent]].transform);
+		}
+	}
+
+	return handles;
+}
+
 glm::mat4 Scene::Camera::make_projection() const {
 	return glm::infinitePerspective( fovy, aspect, near );
 }
 
 //---------------------------
 
-void Scene::render() {
-	glm::mat4 world_to_camera = camera.transform.make_world_to_local();
-	glm::mat4 world_to_clip = camera.make_projection() * world_to_camera;
+namespace {
+	//stable LSD radix sort by key, a byte at a time (bytes that are the same in every key are skipped):
+	void radix_sort(std::vector< Scene::DrawKey > &keys, std::vector< Scene::DrawKey > &scratch) {
+		if (keys.size() < 2) return;
+		scratch.resize(keys.size());
+		for (uint32_t shift = 0; shift < 64; shift += 8) {
+			uint32_t offsets[256] = { 0 };
+			for (auto const &key : keys) {
+				offsets[(key.key >> shift) & 0xff] += 1;
+			}
+			if (offsets[(keys[0].key >> shift) & 0xff] == keys.size()) continue;
+			uint32_t total = 0;
+			for (uint32_t &offset : offsets) {
+				uint32_t count = offset;
+				offset = total;
+				total += count;
+			}
+			for (auto const &key : keys) {
+				scratch[offsets[(key.key >> shift) & 0xff]++] = key;
+			}
+			keys.swap(scratch);
+		}
+	}
+
+	//true if two packets can share an instanced draw call:
+	bool same_draw(Scene::DrawPacket const &a, Scene::DrawPacket const &b) {
+		return (a.key >> 60) == (b.key >> 60) //(pass)
+			&& a.program == b.program && a.vao == b.vao && a.index_type == b.index_type
+			&& a.first == b.first && a.count == b.count && a.base_vertex == b.base_vertex;
+	}
+}
+
+void Scene::render(WorkerPool *pool, Snapshot const *snapshot) {
+	if (snapshot && snapshot->objects.size() != objects.size()) {
+		throw std::runtime_error("Scene::render given a snapshot of " + std::to_string(snapshot->objects.size()) + " objects, but the scene has " + std::to_string(objects.size()) + ".");
+	}
+	//workers share the cached transform matrices, so fill every cache first (rather than racing to fill them):
+	if (pool && !snapshot) update_transforms(*pool);
+
+	//matrices and visibility, from the snapshot if given:
+	auto local_to_world = [&](uint32_t item) -> Affine const & {
+		return snapshot ? snapshot->objects[item].local_to_world : objects.items[item].transform.make_local_to_world();
+	};
+	auto invisible = [&](uint32_t item) {
+		return snapshot ? snapshot->objects[item].invisible : objects.items[item].invisible;
+	};
+	auto uniform_scale = [&](uint32_t item) {
+		return snapshot ? snapshot->objects[item].uniform_scale : objects.items[item].transform.has_uniform_scale();
+	};
+
+	Affine const &world_to_camera = (snapshot ? snapshot->world_to_camera : camera.transform.make_world_to_local());
+	glm::mat4 camera_to_clip = camera.make_projection();
+	glm::mat4 world_to_clip = camera_to_clip * world_to_camera;
+	bool camera_uniform_scale = (snapshot ? snapshot->camera_uniform_scale : camera.transform.has_uniform_scale());
+	Affine const &camera_to_world = (snapshot ? snapshot->camera_to_world : camera.transform.make_local_to_world());
+	glm::vec3 eye(camera_to_world.rows[0].w, camera_to_world.rows[1].w, camera_to_world.rows[2].w);
 
 	//Get world-space position of all lights:
-	for (auto const &light : lights) {
-		glm::mat4 mv = world_to_camera * light.transform.make_local_to_world();
-		(void)mv;
+	// (lights aren't in snapshots -- their transforms may be changing on another thread)
+	if (!snapshot) {
+		for (auto const &light : lights) {
+			Affine mv = world_to_camera * light.transform.make_local_to_world();
+			(void)mv;
+		}
 	}
 
-	for (auto const &object : objects) {
-		if(object.invisible) continue;
-		glm::mat4 local_to_world = object.transform.make_local_to_world();
+	render_stats = RenderStats();
+
+	//split objects into one contiguous slice per worker:
+	// (no GL calls from here until the slices are merged)
+	uint32_t count = uint32_t(objects.size());
+	uint32_t slices = (pool ? pool->size() : 1);
+	render_slices.resize(slices);
+	for (uint32_t s = 0; s < slices; ++s) {
+		RenderSlice &slice = render_slices[s];
+		slice.begin = (s == 0 ? 0 : render_slices[s - 1].end);
+		slice.end = (s + 1 == slices ? count : std::max(slice.begin, uint32_t(uint64_t(count) * (s + 1) / slices) & ~3U));
+	}
+	auto for_each_slice = [&](std::function< void(RenderSlice &) > const &job) {
+		if (pool) pool->run([&](uint32_t worker) { job(render_slices[worker]); });
+		else job(render_slices[0]);
+	};
+
+	//gather world-space bounding spheres of everything, cull them against the view frustum, and note visible occluders:
+	Frustum frustum = Frustum::from_world_to_clip(world_to_clip);
+	render_spheres.resize(count);
+	render_visible.resize(count);
+	for_each_slice([&](RenderSlice &slice) {
+		slice.occluders.clear();
+		slice.cull_tested = slice.cull_culled = slice.occlusion_culled = 0;
+		for (uint32_t item = slice.begin; item < slice.end; ++item) {
+			Object const &object = objects.items[item];
+			Affine const &to_world = local_to_world(item);
+			glm::vec4 center = to_world * glm::vec4(object.bounds.center, 1.0f);
+			//(radius scales by the longest axis)
+			float scale2 = 0.0f;
+			for (int c = 0; c < 3; ++c) {
+				glm::vec3 axis(to_world.rows[0][c], to_world.rows[1][c], to_world.rows[2][c]);
+				scale2 = std::max(scale2, glm::dot(axis, axis));
+			}
+			render_spheres.x[item] = center.x;
+			render_spheres.y[item] = center.y;
+			render_spheres.z[item] = center.z;
+			render_spheres.radius[item] = object.bounds.radius * std::sqrt(scale2);
+		}
+		cull_spheres(frustum, render_spheres, slice.begin, slice.end, render_visible.data());
+		for (uint32_t item = slice.begin; item < slice.end; ++item) {
+			Object const &object = objects.items[item];
+			if (invisible(item)) {
+				render_visible[item] = 0;
+				continue;
+			}
+			slice.cull_tested += 1;
+			if (!render_visible[item]) {
+				slice.cull_culled += 1;
+			} else if (occlusion_culling && object.occluder) {
+				//occluders are the flagged objects that look biggest from the camera:
+				glm::vec3 center(render_spheres.x[item], render_spheres.y[item], render_spheres.z[item]);
+				float size = render_spheres.radius[item] / std::max(glm::length(center - eye), 1e-6f);
+				slice.occluders.emplace_back(size, item);
+			}
+		}
+	});
+
+	render_occluders.clear();
+	for (auto const &slice : render_slices) {
+		render_occluders.insert(render_occluders.end(), slice.occluders.begin(), slice.occluders.end());
+		render_stats.cull_tested += slice.cull_tested;
+		render_stats.cull_culled += slice.cull_culled;
+	}
+	if (render_occluders.size() > max_occluders) {
+		std::nth_element(render_occluders.begin(), render_occluders.begin() + max_occluders, render_occluders.end(),
+			std::greater< std::pair< float, uint32_t > >());
+		render_occluders.resize(max_occluders);
+	}
+	bool occlusion_test = !render_occluders.empty();
+	if (occlusion_test) {
+		occlusion.clear(occlusion_width, occlusion_height);
+		for (auto const &occluder : render_occluders) {
+			Object const &object = objects.items[occluder.second];
+			occlusion.add_occluder(world_to_clip * local_to_world(occluder.second), object.bounds.min, object.bounds.max);
+		}
+		occlusion.rasterize(pool);
+		render_stats.occluders = uint32_t(render_occluders.size());
+
+		//(occluders aren't tested -- each would be compared against its own surface)
+		for (auto const &occluder : render_occluders) {
+			render_visible[occluder.second] = 2;
+		}
+	}
+
+	//occlusion-test what's left, and write a packet (and the per-object constants) for everything that will be drawn:
+	bool queries = occlusion_queries && query_program != 0;
+	render_frame += 1;
+	render_draws.resize(count);
+	for_each_slice([&](RenderSlice &slice) {
+		slice.packets.clear();
+		slice.hidden.clear();
+		slice.queries.clear();
+		slice.query_boxes.clear();
+		slice.pending.clear();
+		for (uint32_t item = slice.begin; item < slice.end; ++item) {
+			Object &object = objects.items[item];
+			if (render_visible[item] == 1 && occlusion_test
+			 && !occlusion.test_box(world_to_clip * local_to_world(item), object.bounds.min, object.bounds.max)) {
+				render_visible[item] = 0;
+				slice.occlusion_culled += 1;
+			}
+			if (!render_visible[item]) {
+				//(query state goes stale out of view, so start over -- as visible -- when the object comes back)
+				object.query_pending = false;
+				object.query_hidden = false;
+				continue;
+			}
+			Draw &draw = render_draws[item];
+
+			//compute modelview (object space to camera local space) matrix for this object:
+			Affine mv = world_to_camera * local_to_world(item);
+
+			//compute modelview+projection (object space to clip space) matrix for this object:
+			// (stored positions are first mapped into the mesh's bounding box -- identity for non-compact meshes)
+			Affine dequantize(
+				glm::vec4(object.dequantize_scale.x, 0.0f, 0.0f, object.dequantize_offset.x),
+				glm::vec4(0.0f, object.dequantize_scale.y, 0.0f, object.dequantize_offset.y),
+				glm::vec4(0.0f, 0.0f, object.dequantize_scale.z, object.dequantize_offset.z)
+			);
+			draw.mvp = camera_to_clip * (mv * dequantize);
+
+			//NOTE: inverse cancels out transpose unless there is scale involved (normal_matrix skips it for uniform scale)
+			glm::mat3 itmv = normal_matrix(mv, camera_uniform_scale && uniform_scale(item));
+			draw.itmv[0] = glm::vec4(itmv[0], 0.0f);
+			draw.itmv[1] = glm::vec4(itmv[1], 0.0f);
+			draw.itmv[2] = glm::vec4(itmv[2], 0.0f);
+
+			//build sort key (camera looks down -z, so view distance is -z):
+			float distance = -glm::dot(mv.rows[2], glm::vec4(object.bounds.center, 1.0f));
+			uint32_t depth = 0;
+			if (distance > 0.0f) std::memcpy(&depth, &distance, sizeof(depth));
+			depth >>= 11; //(sign bit is zero, so this keeps the top 20 bits that vary)
+			uint64_t pass = std::min< uint32_t >(object.pass, 0xfU);
+			uint64_t state = (uint64_t(std::min(object.program, 0x3ffU)) << 30)
+				| (uint64_t(std::min(object.vao, 0x3ffU)) << 20)
+				| uint64_t(std::min(object.mesh, 0xfffffU));
+			DrawPacket packet;
+			if (object.pass == 0) {
+				packet.key = (pass << 60) | (state << 20) | uint64_t(depth);
+			} else {
+				packet.key = (pass << 60) | (uint64_t(~depth & 0xfffffU) << 40) | state;
+			}
+			packet.item = item;
+			packet.program = object.program;
+			packet.vao = object.vao;
+			packet.index_type = object.index_type;
+			packet.first = (object.index_type ? object.index_start : object.start);
+			packet.count = (object.index_type ? object.index_count : object.count);
+			packet.base_vertex = (object.index_type ? object.base_vertex : 0);
+
+			//hardware occlusion queries (only for opaque objects -- later passes don't write depth, and draw in order):
+			// (results are read on the calling thread, after this, so they steer the next frame)
+			if (queries && object.pass == 0) {
+				if (object.query_pending) slice.pending.emplace_back(item);
+				//hidden objects are re-queried as soon as their last result is read (their draws depend on it), visible
+				// ones every query_interval frames; never while a result is outstanding, as re-issuing would discard it:
+				if (!object.query_pending && (object.query_hidden || (render_frame + item) % std::max(query_interval, 1U) == 0)) {
+					glm::vec3 extent = object.bounds.max - object.bounds.min;
+					glm::mat4 box = camera_to_clip * (mv * Affine(
+						glm::vec4(extent.x, 0.0f, 0.0f, object.bounds.min.x),
+						glm::vec4(0.0f, extent.y, 0.0f, object.bounds.min.y),
+						glm::vec4(0.0f, 0.0f, extent.z, object.bounds.min.z)
+					));
+					//nearest corner of the unit cube (smallest clip w):
+					float nearest = box[3][3] + std::min(box[0][3], 0.0f) + std::min(box[1][3], 0.0f) + std::min(box[2][3], 0.0f);
+					if (nearest < 2.0f * camera.near) {
+						//the box would be clipped by the near plane, so its query could miss the object -- just draw it:
+						object.query_hidden = false;
+					} else {
+						slice.queries.emplace_back(item);
+						slice.query_boxes.emplace_back(box);
+					}
+				}
+				if (object.query_hidden) {
+					slice.hidden.emplace_back(packet);
+					continue;
+				}
+			}
+			slice.packets.emplace_back(packet);
+		}
+	});
 
-		//compute modelview+projection (object space to clip space) matrix for this object:
-		glm::mat4 mvp = world_to_clip * local_to_world;
+	//---- GL thread only from here ----
 
-		//compute modelview (object space to camera local space) matrix for this object:
-		glm::mat4 mv = world_to_camera * local_to_world;
+	//read back whichever query results are ready (never waiting for the GPU):
+	for (auto const &slice : render_slices) {
+		for (uint32_t item : slice.pending) {
+			Object &object = objects.items[item];
+			GLuint available = GL_FALSE;
+			glGetQueryObjectuiv(object.query, GL_QUERY_RESULT_AVAILABLE, &available);
+			if (available) {
+				GLuint passed = 0;
+				glGetQueryObjectuiv(object.query, GL_QUERY_RESULT, &passed);
+				object.query_hidden = (passed == 0);
+				object.query_pending = false;
+				render_stats.query_results += 1;
+			}
+		}
+	}
 
-		//NOTE: inverse cancels out transpose unless there is scale involved
-		glm::mat3 itmv = glm::inverse(glm::transpose(glm::mat3(mv)));
+	//merge slices (in order, so the queue is in storage order before sorting):
+	render_packets.clear();
+	render_queue.clear();
+	render_queries.clear();
+	render_query_boxes.clear();
+	GLuint list_program = 0, list_vao = 0; //(state in storage order, for render_stats.unsorted_binds)
+	for (auto const &slice : render_slices) {
+		for (auto const &packet : slice.packets) {
+			DrawKey key;
+			key.key = packet.key;
+			key.packet = uint32_t(render_packets.size());
+			render_queue.emplace_back(key);
+			render_packets.emplace_back(packet);
 
-		//set up program uniforms:
-		glUseProgram(object.program);
-		if (object.program_mvp != -1U) {
-			glUniformMatrix4fv(object.program_mvp, 1, GL_FALSE, glm::value_ptr(mvp));
+			render_stats.unsorted_binds += (packet.program != list_program) + (packet.vao != list_vao);
+			list_program = packet.program;
+			list_vao = packet.vao;
 		}
-		if (object.program_itmv != -1U) {
-			glUniformMatrix3fv(object.program_itmv, 1, GL_FALSE, glm::value_ptr(itmv));
+		render_queries.insert(render_queries.end(), slice.queries.begin(), slice.queries.end());
+		render_query_boxes.insert(render_query_boxes.end(), slice.query_boxes.begin(), slice.query_boxes.end());
+		render_stats.occlusion_culled += slice.occlusion_culled;
+	}
+	uint32_t hidden_begin = uint32_t(render_packets.size());
+	for (auto const &slice : render_slices) {
+		render_packets.insert(render_packets.end(), slice.hidden.begin(), slice.hidden.end());
+	}
+	for (uint32_t item : render_queries) {
+		Object &object = objects.items[item];
+		if (object.query == 0) {
+			if (free_queries.empty()) {
+				free_queries.resize(64);
+				glGenQueries(GLsizei(free_queries.size()), free_queries.data());
+			}
+			object.query = free_queries.back();
+			free_queries.pop_back();
 		}
+	}
 
-		glBindVertexArray(object.vao);
+	radix_sort(render_queue, render_queue_scratch);
 
-		//draw the object:
-		glDrawArrays(GL_TRIANGLES, object.start, object.count);
+	//split into batches -- runs of identical draws, at most InstancesPerBlock long -- and place each in the ring:
+	if (ring_alignment == 0) {
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &ring_alignment);
+		ring_alignment = std::max(ring_alignment, GLint(16));
 	}
+	render_batches.clear();
+	uint32_t ring_bytes = 0; //(end of the data written)
+	//every bind covers a whole block -- smaller ranges than the block's declared size are undefined --
+	// so the region must also hold a full block after the last offset bound:
+	uint32_t ring_reserved = 0;
+	for (uint32_t begin = 0; begin < render_queue.size(); ) {
+		DrawPacket const &packet = render_packets[render_queue[begin].packet];
+		uint32_t end = begin + 1;
+		while (end < render_queue.size() && end - begin < InstancesPerBlock
+			&& same_draw(render_packets[render_queue[end].packet], packet)) {
+			++end;
+		}
+		Batch batch;
+		batch.begin = begin;
+		batch.count = end - begin;
+		batch.offset = (ring_bytes + ring_alignment - 1) / ring_alignment * ring_alignment;
+		batch.query = 0;
+		render_batches.emplace_back(batch);
+		ring_bytes = batch.offset + batch.count * sizeof(Draw);
+		ring_reserved = batch.offset + InstancesPerBlock * sizeof(Draw);
+		begin = end;
+	}
+	uint32_t sorted_batches = uint32_t(render_batches.size());
+	//hidden objects go after the sorted draws, one conditional draw each:
+	for (uint32_t p = hidden_begin; p < render_packets.size(); ++p) {
+		DrawKey key;
+		key.key = 0;
+		key.packet = p;
+		Batch batch;
+		batch.begin = uint32_t(render_queue.size());
+		batch.count = 1;
+		batch.offset = (ring_bytes + ring_alignment - 1) / ring_alignment * ring_alignment;
+		batch.query = objects.items[render_packets[p].item].query;
+		render_queue.emplace_back(key);
+		render_batches.emplace_back(batch);
+		ring_bytes = batch.offset + sizeof(Draw);
+		ring_reserved = batch.offset + InstancesPerBlock * sizeof(Draw);
+	}
+	//then the query boxes, in blocks of BoxesPerBlock:
+	render_query_offsets.clear();
+	for (uint32_t first = 0; first < render_query_boxes.size(); first += BoxesPerBlock) {
+		uint32_t offset = (ring_bytes + ring_alignment - 1) / ring_alignment * ring_alignment;
+		render_query_offsets.emplace_back(offset);
+		ring_bytes = offset + std::min(BoxesPerBlock, uint32_t(render_query_boxes.size()) - first) * sizeof(glm::mat4);
+		ring_reserved = offset + BoxesPerBlock * sizeof(glm::mat4);
+	}
+	render_stats.uniform_bytes = ring_bytes;
+	render_stats.queries = uint32_t(render_queries.size());
+	render_stats.query_hidden = uint32_t(render_packets.size()) - hidden_begin;
+	if (render_batches.empty()) return;
+
+	//pick the next ring region; it was last written RingRegions frames ago, so its fence has almost always signalled:
+	if (ring_buffer == 0) glGenBuffers(1, &ring_buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, ring_buffer);
+	ring_region = (ring_region + 1) % RingRegions;
+	bool orphan = false;
+	if (ring_reserved > ring_region_size) {
+		ring_region_size = std::max(ring_reserved, 2 * ring_region_size);
+		ring_region_size = (ring_region_size + ring_alignment - 1) / ring_alignment * ring_alignment;
+		orphan = true;
+	} else if (ring_fences[ring_region] && glClientWaitSync(ring_fences[ring_region], 0, 0) == GL_TIMEOUT_EXPIRED) {
+		//GPU is still reading this region -- rather than wait, let the driver hand us fresh storage:
+		orphan = true;
+		render_stats.ring_orphans += 1;
+	}
+	if (orphan) {
+		glBufferData(GL_UNIFORM_BUFFER, GLsizeiptr(RingRegions) * ring_region_size, nullptr, GL_STREAM_DRAW);
+		for (GLsync &fence : ring_fences) {
+			if (fence) glDeleteSync(fence);
+			fence = 0;
+		}
+	} else if (ring_fences[ring_region]) {
+		glDeleteSync(ring_fences[ring_region]);
+		ring_fences[ring_region] = 0;
+	}
+	GLintptr region_offset = GLintptr(ring_region) * ring_region_size;
+
+	//write every batch's constants in one contiguous pass (no GL calls in the loop):
+	char *mapped = (char *)glMapBufferRange(GL_UNIFORM_BUFFER, region_offset, ring_bytes,
+		GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (!mapped) {
+		std::cerr << "WARNING: failed to map uniform ring; skipping draws." << std::endl;
+		return;
+	}
+	for (auto const &batch : render_batches) {
+		Draw *out = reinterpret_cast< Draw * >(mapped + batch.offset);
+		for (uint32_t i = 0; i < batch.count; ++i) {
+			out[i] = render_draws[render_packets[render_queue[batch.begin + i].packet].item];
+		}
+	}
+	for (uint32_t block = 0; block < render_query_offsets.size(); ++block) {
+		uint32_t first = block * BoxesPerBlock;
+		uint32_t count = std::min(BoxesPerBlock, uint32_t(render_query_boxes.size()) - first);
+		std::memcpy(mapped + render_query_offsets[block], &render_query_boxes[first], count * sizeof(glm::mat4));
+	}
+	if (glUnmapBuffer(GL_UNIFORM_BUFFER) != GL_TRUE) {
+		std::cerr << "WARNING: uniform ring contents were lost; skipping draws." << std::endl;
+		return;
+	}
+
+	//submit, skipping redundant binds; each batch is one range bind and one instanced draw:
+	GLuint bound_program = 0;
+	GLuint bound_vao = 0;
+	//binds are counted against the sorted queue's own state, as unsorted_binds is against storage order --
+	// so the query pass, the hidden objects' draws, and the rebinds they force are in neither:
+	GLuint counted_program = 0, counted_vao = 0;
+	auto submit = [&](Batch const &batch) {
+		DrawPacket const &packet = render_packets[render_queue[batch.begin].packet];
+
+		if (packet.program != bound_program) {
+			glUseProgram(packet.program);
+			bound_program = packet.program;
+		}
+
+		if (packet.vao != bound_vao) {
+			glBindVertexArray(packet.vao);
+			bound_vao = packet.vao;
+		}
+
+		if (batch.query == 0) {
+			render_stats.program_binds += (packet.program != counted_program);
+			render_stats.vao_binds += (packet.vao != counted_vao);
+			counted_program = packet.program;
+			counted_vao = packet.vao;
+		}
+
+		glBindBufferRange(GL_UNIFORM_BUFFER, InstancesBinding, ring_buffer, region_offset + batch.offset, InstancesPerBlock * sizeof(Draw));
+
+		//(the GPU waits for the query -- issued this frame, or still in flight from an earlier one -- but the CPU doesn't)
+		if (batch.query) glBeginConditionalRender(batch.query, GL_QUERY_WAIT);
+		if (packet.index_type) {
+			glDrawElementsInstancedBaseVertex(GL_TRIANGLES, packet.count, packet.index_type, (GLbyte *)0 + packet.first, batch.count, packet.base_vertex);
+		} else {
+			glDrawArraysInstanced(GL_TRIANGLES, packet.first, packet.count, batch.count);
+		}
+		if (batch.query) glEndConditionalRender();
+		render_stats.draws += batch.count;
+		render_stats.draw_calls += 1;
+	};
+
+	//opaque objects first, so their depth is there to test query boxes against:
+	uint32_t opaque_batches = 0;
+	while (opaque_batches < sorted_batches && (render_packets[render_queue[render_batches[opaque_batches].begin].packet].key >> 60) == 0) {
+		submit(render_batches[opaque_batches++]);
+	}
+
+	if (!render_queries.empty()) {
+		//query boxes test depth, but write nothing:
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		glDepthMask(GL_FALSE);
+		if (query_vao == 0) glGenVertexArrays(1, &query_vao);
+		glUseProgram(query_program);
+		bound_program = query_program;
+		glBindVertexArray(query_vao);
+		bound_vao = query_vao;
+		for (uint32_t i = 0; i < render_queries.size(); ++i) {
+			if (i % BoxesPerBlock == 0) {
+				glBindBufferRange(GL_UNIFORM_BUFFER, InstancesBinding, ring_buffer, region_offset + render_query_offsets[i / BoxesPerBlock], BoxesPerBlock * sizeof(glm::mat4));
+			}
+			Object &object = objects.items[render_queries[i]];
+			glBeginQuery(GL_ANY_SAMPLES_PASSED, object.query);
+			glDrawArrays(GL_TRIANGLE_STRIP, GLint(i % BoxesPerBlock) * 14, 14);
+			glEndQuery(GL_ANY_SAMPLES_PASSED);
+			object.query_pending = true;
+		}
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+		glDepthMask(GL_TRUE);
+	}
+
+	//then the objects that were hidden, each conditional on its query:
+	for (uint32_t b = sorted_batches; b < render_batches.size(); ++b) {
+		submit(render_batches[b]);
+	}
+
+	//and the later passes:
+	for (uint32_t b = opaque_batches; b < sorted_batches; ++b) {
+		submit(render_batches[b]);
+	}
+
+	ring_fences[ring_region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
 }
@@ -1,10 +1,16 @@
 #pragma once
 
 #include "GL.hpp"
+#include "Affine.hpp"
+#include "Frustum.hpp"
+#include "OcclusionBuffer.hpp"
+#include "Meshes.hpp"
+#include "NameTable.hpp"
+#include "SlotMap.hpp"
+#include "WorkerPool.hpp"
 #include <glm/glm.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include <vector>
-#include <list>
 #include <string>
 
 #undef near //windows.h steps on this
@@ -14,6 +20,10 @@ struct Scene {
 	struct Transform {
 		Transform() = default;
 		Transform(Transform &) = delete;
+		//moving a transform takes over its place in the hierarchy (parent, siblings, and children are relinked),
+		// which lets transforms live in relocatable storage (e.g., inside Objects in a SlotMap):
+		Transform(Transform &&other) noexcept;
+		Transform &operator=(Transform &&other) noexcept;
 		~Transform() {
 			while (last_child) {
 				last_child->set_parent(nullptr);
@@ -24,10 +34,15 @@ struct Scene {
 		}
 
 		//simple specification:
+		// (read freely, but change through the set_* functions so cached matrices stay up to date)
 		glm::vec3 position = glm::vec3(0.0f, 0.0f, 0.0f);
 		glm::quat rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f); //constructor is w x y z for some reason.
 		glm::vec3 scale = glm::vec3(1.0f, 1.0f, 1.0f);
 
+		void set_position(glm::vec3 const &position);
+		void set_rotation(glm::quat const &rotation);
+		void set_scale(glm::vec3 const &scale);
+
 		//hierarchy information:
 		Transform *parent = nullptr;
 		Transform *last_child = nullptr;
@@ -38,14 +53,36 @@ struct Scene {
 		//Add transform to the child list of 'parent', before child 'before':
 		void set_parent(Transform *parent, Transform *before = nullptr);
 
+		//helper for moves -- copy everything from 'other' and relink its neighbors to this:
+		void take_place_of(Transform &other);
+
 		//helper that checks local pointer consistency:
 		void DEBUG_assert_valid_pointers() const;
 
 		//computed from the above:
-		glm::mat4 make_local_to_parent() const;
-		glm::mat4 make_parent_to_local() const;
-		glm::mat4 make_local_to_world() const;
-		glm::mat4 make_world_to_local() const;
+		Affine make_local_to_parent() const;
+		Affine make_parent_to_local() const;
+		//(cached; O(1) unless this transform or an ancestor changed since the last call)
+		Affine const &make_local_to_world() const;
+		Affine const &make_world_to_local() const;
+		//true if this transform and all its ancestors scale uniformly (so normals need no inverse; see normal_matrix):
+		bool has_uniform_scale() const;
+
+		//bring the cached local_to_world of every transform under 'roots' up to date, spread across 'pool':
+		// (each worker calls make_local_to_world, parents before children, so results are bit-identical to the serial path)
+		static void update_local_to_world(std::vector< Transform const * > const &roots, WorkerPool &pool);
+
+		//invalidate cached matrices of this transform and its descendants:
+		// (done by set_* and set_parent; call it after changing position/rotation/scale directly)
+		void mark_dirty();
+
+		//cache:
+		// (if a transform's cache is dirty, so are all of its descendants', which lets mark_dirty stop early)
+		mutable Affine local_to_world;
+		mutable Affine world_to_local;
+		mutable bool uniform_scale = true; //(updated along with local_to_world)
+		mutable bool local_to_world_dirty = true;
+		mutable bool world_to_local_dirty = true;
 	};
 	struct Camera {
 		Transform transform;
@@ -58,16 +95,32 @@ struct Scene {
 	};
 	struct Object {
 		Transform transform;
-		std::string name;
+		MeshId mesh = -1U; //mesh this object was made from
+		NameId name = -1U; //in Scene::names (change with Scene::set_name, so the name index stays current)
+		SlotHandle< Object > next_named; //next object with the same name (see Scene::named)
 		bool invisible = false;
+		bool occluder = false; //its bounding box is solid (e.g., a crate or a wall), so it can hide objects behind it
+		//render pass: pass 0 (opaque) draws first, front to back; later passes (e.g., blended) draw in order, back to front:
+		uint8_t pass = 0;
 		//geometric info:
 		GLuint vao = 0;
 		GLuint start = 0;
 		GLuint count = 0;
-		//program info:
+		GLenum index_type = 0; //if non-zero, draw with indices (see Mesh::index_*)
+		GLuint index_start = 0;
+		GLuint index_count = 0;
+		GLint base_vertex = 0;
+		//compact meshes store positions within a bounding box (see Mesh::dequantize_*):
+		glm::vec3 dequantize_offset = glm::vec3(0.0f);
+		glm::vec3 dequantize_scale = glm::vec3(1.0f);
+		//object-space bounding volumes (see Mesh::bounds):
+		MeshBounds bounds;
+		//program info (per-object matrices come from the Instances uniform block; see Scene::render):
 		GLuint program = 0;
-		GLuint program_mvp = -1U; //uniform index for MVP matrix
-		GLuint program_itmv = -1U; //uniform index for inverse(transpose(mv)) matrix
+		//hardware occlusion query state (kept by Scene::render; see Scene::occlusion_queries):
+		GLuint query = 0; //(returned to Scene::free_queries by Scene::remove_object)
+		bool query_pending = false; //issued, but the result hasn't been read yet
+		bool query_hidden = false; //no samples passed the last query read back
 	};
 	struct Light {
 		Transform transform;
@@ -76,8 +129,182 @@ struct Scene {
 	};
 
 	Camera camera;
-	std::list< Object > objects;
-	std::list< Light > lights;
+	//objects and lights are stored densely; refer to them by handle (pointers move on add/remove):
+	SlotMap< Object > objects;
+	SlotMap< Light > lights;
+	typedef SlotMap< Object >::Handle ObjectHandle;
+	typedef SlotMap< Light >::Handle LightHandle;
+
+	//shader programs given to objects made from meshes (compact meshes need the dequantizing vertex shader):
+	// every program reads its matrices as
+	//   struct Instance { mat4 mvp; mat3 itmv; };
+	//   layout(std140) uniform Instances { Instance instances[InstancesPerBlock]; };
+	// indexed by gl_InstanceID, with the block bound to uniform buffer binding InstancesBinding.
+	GLuint mesh_program = 0;
+	GLuint compact_mesh_program = 0;
+	static const uint32_t InstancesPerBlock = 128; //(128 * 112 bytes fits GL's minimum 16k block size)
+	static const GLuint InstancesBinding = 0;
+
+	//add an object that draws mesh 'id' (at the origin, with no parent):
+	ObjectHandle add_object(Meshes &meshes, MeshId id);
+	//remove an object (dropping it from the name index, and keeping its occlusion query for reuse):
+	// (removing through objects.remove directly would leave a stale handle in the index)
+	void remove_object(ObjectHandle handle);
+
+	//object names are interned; the index maps each name to the objects that have it:
+	NameTable names;
+	std::vector< ObjectHandle > named; //by NameId: most recently named object with that name, chained through Object::next_named
+	void set_name(ObjectHandle handle, NameId name);
+	void set_name(ObjectHandle handle, std::string const &name) { set_name(handle, names.intern(name)); }
+
+	//find an object by name (one hash, no allocation); returns an invalid handle if none has that name:
+	// (if several objects share the name, returns the one named most recently)
+	ObjectHandle find(std::string const &name) const;
+	//append every object whose name starts with 'prefix' (in name order) to 'found':
+	void find_prefix(std::string const &prefix, std::vector< ObjectHandle > *found) const;
+
+	//add the objects in a scene blob ("str0" names, "scn0" entries, and an optional "hier" chunk):
+	// all objects are created in one pass, then linked to their parents by index (no name compares).
+	// each object is named after its mesh, with names interned straight from the str0 chunk.
+	// returns the handle made for each scn0 entry, in file order.
+	// (throws -- before adding anything -- if the blob is malformed or names a mesh 'meshes' doesn't have)
+	std::vector< ObjectHandle > load(std::string const &filename, Meshes &meshes);
+
+	//update cached local_to_world matrices of everything in the scene (in parallel; see Transform::update_local_to_world):
+	void update_transforms(WorkerPool &pool);
+
+	//a copy of everything render() reads that simulation changes (so simulation can run on another thread;
+	// see TripleBuffer). Objects are by item in objects.items, so none may be added or removed while one is in use.
+	struct Snapshot {
+		Affine camera_to_world, world_to_camera;
+		bool camera_uniform_scale = true;
+		struct ObjectState {
+			Affine local_to_world;
+			bool invisible;
+			bool uniform_scale;
+		};
+		std::vector< ObjectState > objects;
+	};
+	//fill 'into' from the current transforms and visibility (reusing its storage):
+	void snapshot(Snapshot &into) const;
+
+	//draw every visible object whose bounding sphere is in the view frustum, sorted by render key (see below):
+	// if occlusion_culling is set, objects hidden behind occluders are skipped too.
+	// runs of objects with the same program and geometry are drawn with one instanced draw call.
+	// if occlusion_queries is set (and query_program given), hardware queries catch what the CPU test missed.
+	// if 'pool' is given, per-object work (culling, matrices, keys) is split across it, one slice of objects per worker
+	// (see RenderSlice), and transforms are brought up to date on it first; only the calling thread makes GL calls.
+	// if 'snapshot' is given, matrices and visibility come from it and transforms aren't touched at all, so another
+	// thread may be changing them meanwhile (render still writes each object's query_* fields).
+	void render(WorkerPool *pool = nullptr, Snapshot const *snapshot = nullptr);
+
+	//CPU occlusion culling: each frame, the (at most) max_occluders biggest on-screen occluder objects are
+	// rasterized into a small depth buffer, and every other object's bounding box is tested against it:
+	bool occlusion_culling = true;
+	uint32_t max_occluders = 64;
+	uint32_t occlusion_width = 256, occlusion_height = 128;
+	OcclusionBuffer occlusion;
+	std::vector< std::pair< float, uint32_t > > render_occluders; //(screen size, item) of this frame's occluders
+
+	//hardware occlusion queries (used if query_program is set): opaque objects that were hidden at their last
+	// query have their bounding boxes drawn with a GL_ANY_SAMPLES_PASSED query after the other opaque objects,
+	// then are drawn under conditional rendering on that query; objects that were visible are drawn normally
+	// and re-queried every query_interval frames (staggered). Results are only read once available, so the
+	// CPU never waits for the GPU -- a late result just means the cached state is a few frames old. Until it
+	// is read, an object isn't queried again (hidden ones keep drawing conditionally on the outstanding query).
+	// query_program draws box i of a Boxes block as a 14-vertex triangle strip starting at vertex 14 * i:
+	//   layout(std140) uniform Boxes { mat4 boxes[BoxesPerBlock]; };
+	// (each box maps the unit cube to an object's bounding box in clip space), bound to InstancesBinding.
+	bool occlusion_queries = true;
+	GLuint query_program = 0;
+	uint32_t query_interval = 8;
+	static const uint32_t BoxesPerBlock = 256; //(256 * 64 bytes is GL's minimum block size)
+	GLuint query_vao = 0; //(empty -- boxes come from gl_VertexID; created on first use)
+	std::vector< GLuint > free_queries; //query objects not used by any object
+
+	//render queue -- one key per visible object, radix-sorted so that objects sharing state are drawn together:
+	// key bits (high to low), pass 0: pass (4) | program (10) | vao (10) | mesh (20) | depth (20)
+	//                     later passes: pass (4) | inverted depth (20) | program (10) | vao (10) | mesh (20)
+	// (program and vao are GL names, which are small in practice; larger values share the top value and just group less well)
+	// (depth is the top bits of the view distance to the bounding sphere center -- monotonic for non-negative floats)
+	struct DrawKey {
+		uint64_t key;
+		uint32_t packet; //index in render_packets
+	};
+	//everything the submission loop needs to draw an object (written by the workers, so GL calls never touch Objects):
+	struct DrawPacket {
+		uint64_t key;
+		uint32_t item; //index in objects.items (and render_draws)
+		GLuint program;
+		GLuint vao;
+		GLenum index_type; //if non-zero, draw 'count' indices starting 'first' bytes into the index buffer
+		GLuint first, count; //(otherwise, 'count' vertices starting at vertex 'first')
+		GLint base_vertex;
+	};
+	//per-object constants, laid out as a std140 Instance (mat3 columns are padded to vec4s):
+	struct Draw {
+		glm::mat4 mvp;
+		glm::vec4 itmv[3];
+	};
+	static_assert(sizeof(Draw) == 112, "Draw matches the std140 layout of Instance");
+	//a draw call -- up to InstancesPerBlock consecutive queue entries, whose Draws are at 'offset' in the current ring region:
+	struct Batch {
+		uint32_t begin, count; //range in render_queue
+		uint32_t offset; //bytes (a multiple of GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT)
+		GLuint query; //if non-zero, drawn under conditional rendering on this query
+	};
+	//what one worker produces from its slice of objects.items (the calling thread merges slices in order):
+	struct RenderSlice {
+		uint32_t begin = 0, end = 0; //items (multiples of four, except the last end -- so slices never share a group of spheres)
+		std::vector< std::pair< float, uint32_t > > occluders; //(screen size, item) of occluders in the frustum
+		std::vector< DrawPacket > packets; //objects to sort and draw
+		std::vector< DrawPacket > hidden; //objects to draw under conditional rendering
+		std::vector< uint32_t > queries; //items to query
+		std::vector< glm::mat4 > query_boxes; //(one per query)
+		std::vector< uint32_t > pending; //items whose last query result hasn't been read
+		uint32_t cull_tested = 0, cull_culled = 0, occlusion_culled = 0;
+	};
+	//(kept between frames to reuse allocations)
+	std::vector< RenderSlice > render_slices;
+	std::vector< DrawPacket > render_packets; //every slice's packets, then every slice's hidden packets
+	std::vector< DrawKey > render_queue, render_queue_scratch;
+	std::vector< Draw > render_draws; //by item
+	std::vector< Batch > render_batches;
+	SphereArrays render_spheres; //world-space bounds of each object, by item, for culling
+	std::vector< uint8_t > render_visible; //by item: 0 = culled (or invisible), 1 = visible, 2 = visible occluder
+	std::vector< uint32_t > render_queries; //item of each object queried this frame
+	std::vector< glm::mat4 > render_query_boxes; //unit cube to clip space, for each of render_queries
+	std::vector< uint32_t > render_query_offsets; //ring offset of each block of BoxesPerBlock boxes
+	uint32_t render_frame = 0; //(staggers re-queries)
+
+	//per-frame constants are written to one region of a triple-buffered uniform buffer ring;
+	// a fence per region tells when the GPU is done reading it, so writes never need to synchronize:
+	static const uint32_t RingRegions = 3;
+	GLuint ring_buffer = 0; //(created on first render)
+	uint32_t ring_region_size = 0; //bytes; grows (by reallocating the buffer) as needed
+	uint32_t ring_region = 0; //region written last frame
+	GLsync ring_fences[RingRegions] = { 0, 0, 0 };
+	GLint ring_alignment = 0; //GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
 
-	void render();
+	//counts from the last render:
+	struct RenderStats {
+		uint32_t cull_tested = 0; //objects tested against the view frustum
+		uint32_t cull_culled = 0; //objects entirely outside it (so not drawn)
+		uint32_t occluders = 0; //objects rasterized into the occlusion buffer
+		uint32_t occlusion_culled = 0; //objects in the frustum, but hidden behind occluders
+		uint32_t queries = 0; //hardware occlusion queries issued
+		uint32_t query_results = 0; //query results read back (only ever ones already available)
+		uint32_t query_hidden = 0; //objects drawn under conditional rendering (hidden at their last query)
+		uint32_t draws = 0; //objects drawn (including conditionally)
+		uint32_t draw_calls = 0; //(instanced) draw calls issued
+		uint32_t program_binds = 0; //glUseProgram calls the sorted draws needed
+		uint32_t vao_binds = 0; //glBindVertexArray calls the sorted draws needed
+		uint32_t unsorted_binds = 0; //program + vao binds the same draws would have needed in storage order
+		//(without any elision, every draw would need two; none of these count the query pass or hidden objects)
+		//(signed: pass-major sort keys can split runs that storage order kept together)
+		int64_t binds_saved() const { return int64_t(unsorted_binds) - program_binds - vao_binds; }
+		uint32_t uniform_bytes = 0; //per-object constants written to the ring
+		uint32_t ring_orphans = 0; //times the ring was re-allocated instead of waiting for the GPU (0 or 1)
+	};
+	RenderStats render_stats;
 };
@@ -0,0 +1,119 @@
+#pragma once
+
+#include <vector>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <stdint.h>
+
+//handle to an item in a SlotMap< T > (declared outside SlotMap so that T itself can hold handles):
+template< typename T >
+struct SlotHandle {
+	uint32_t slot = -1U;
+	uint32_t generation = 0;
+	bool operator==(SlotHandle const &other) const { return slot == other.slot && generation == other.generation; }
+	bool operator!=(SlotHandle const &other) const { return !(*this == other); }
+};
+
+//"SlotMap" stores items densely (so iteration is a linear walk over a vector) and hands out
+// generational handles to them. Removing an item moves the last item into its place, but handles
+// go through a slot table, so they stay valid; a removed item's handle is detectably stale
+// (its slot's generation has moved on), even once the slot is reused.
+// (T must be move-constructible and move-assignable; pointers to items are invalidated by emplace and remove.)
+template< typename T >
+struct SlotMap {
+	typedef SlotHandle< T > Handle;
+
+	template< typename... Args >
+	Handle emplace(Args&&... args) {
+		uint32_t slot;
+		if (first_free != -1U) {
+			slot = first_free;
+			first_free = slots[slot].next_free;
+		} else {
+			slot = uint32_t(slots.size());
+			slots.emplace_back();
+		}
+		items.emplace_back(std::forward< Args >(args)...);
+		owners.emplace_back(slot);
+		slots[slot].item = uint32_t(items.size()) - 1;
+
+		Handle handle;
+		handle.slot = slot;
+		handle.generation = slots[slot].generation;
+		return handle;
+	}
+
+	//remove the item 'handle' refers to (returns false -- and does nothing -- if the handle is stale):
+	bool remove(Handle handle) {
+		if (!valid(handle)) return false;
+		Slot &slot = slots[handle.slot];
+		uint32_t last = uint32_t(items.size()) - 1;
+		if (slot.item != last) {
+			items[slot.item] = std::move(items[last]);
+			owners[slot.item] = owners[last];
+			slots[owners[last]].item = slot.item;
+		}
+		items.pop_back();
+		owners.pop_back();
+
+		slot.item = -1U;
+		slot.generation += 1;
+		slot.next_free = first_free;
+		first_free = handle.slot;
+		return true;
+	}
+
+	bool valid(Handle handle) const {
+		return handle.slot < slots.size()
+			&& slots[handle.slot].generation == handle.generation
+			&& slots[handle.slot].item != -1U;
+	}
+
+	//nullptr if 'handle' is stale:
+	T *get(Handle handle) { return valid(handle) ? &items[slots[handle.slot].item] : nullptr; }
+	T const *get(Handle handle) const { return valid(handle) ? &items[slots[handle.slot].item] : nullptr; }
+
+	//throws if 'handle' is stale:
+	T &operator[](Handle handle) { return items[checked_item(handle)]; }
+	T const &operator[](Handle handle) const { return items[checked_item(handle)]; }
+
+	//handle of an item in this map (e.g., found while iterating):
+	Handle handle_of(T const &item) const {
+		Handle handle;
+		handle.slot = owners[&item - items.data()];
+		handle.generation = slots[handle.slot].generation;
+		return handle;
+	}
+
+	void reserve(size_t count) {
+		items.reserve(count);
+		owners.reserve(count);
+		slots.reserve(count);
+	}
+
+	size_t size() const { return items.size(); }
+	bool empty() const { return items.empty(); }
+	typename std::vector< T >::iterator begin() { return items.begin(); }
+	typename std::vector< T >::iterator end() { return items.end(); }
+	typename std::vector< T >::const_iterator begin() const { return items.begin(); }
+	typename std::vector< T >::const_iterator end() const { return items.end(); }
+
+	//storage:
+	std::vector< T > items; //dense, in no particular order
+	std::vector< uint32_t > owners; //slot of each item
+	struct Slot {
+		uint32_t item = -1U; //index in items, or -1U when free
+		uint32_t generation = 0; //incremented on remove
+		uint32_t next_free = -1U; //(free list)
+	};
+	std::vector< Slot > slots;
+	uint32_t first_free = -1U;
+
+	uint32_t checked_item(Handle handle) const {
+		if (!valid(handle)) {
+			throw std::runtime_error("SlotMap: stale handle (slot " + std::to_string(handle.slot) + ", generation " + std::to_string(handle.generation) + ")");
+		}
+		return slots[handle.slot].item;
+	}
+};
@@ -0,0 +1,286 @@
+#include "TransformStore.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TRANSFORM_STORE_SSE
+#include <emmintrin.h>
+#endif
+
+constexpr TransformStore::Handle TransformStore::None;
+
+namespace {
+	//reorder so that (*array)[i] becomes the old (*array)[order[i]]:
+	template< typename T >
+	void gather(std::vector< uint32_t > const &order, std::vector< T > *array) {
+		std::vector< T > sorted;
+		sorted.reserve(array->size());
+		for (uint32_t s : order) sorted.emplace_back((*array)[s]);
+		array->swap(sorted);
+	}
+}
+
+uint32_t TransformStore::slot_of(Handle handle) const {
+	if (handle >= slots.size() || slots[handle] == None) {
+		throw std::runtime_error("TransformStore: invalid handle " + std::to_string(handle));
+	}
+	return slots[handle];
+}
+
+TransformStore::Handle TransformStore::add(Handle parent) {
+	uint32_t parent_slot = (parent == None ? None : slot_of(parent));
+
+	Handle handle;
+	if (!free_handles.empty()) {
+		handle = free_handles.back();
+		free_handles.pop_back();
+	} else {
+		handle = Handle(slots.size());
+		slots.emplace_back(None);
+	}
+
+	//appending keeps parents-first order, since the parent is already in the arrays:
+	uint32_t slot = uint32_t(parents.size());
+	position_x.emplace_back(0.0f); position_y.emplace_back(0.0f); position_z.emplace_back(0.0f);
+	rotation_x.emplace_back(0.0f); rotation_y.emplace_back(0.0f); rotation_z.emplace_back(0.0f); rotation_w.emplace_back(1.0f);
+	scale_x.emplace_back(1.0f); scale_y.emplace_back(1.0f); scale_z.emplace_back(1.0f);
+	parents.emplace_back(parent_slot);
+	world.emplace_back(1.0f);
+	handles.emplace_back(handle);
+	slots[handle] = slot;
+
+	return handle;
+}
+
+void TransformStore::move_slot(uint32_t from, uint32_t to) {
+	position_x[to] = position_x[from]; position_y[to] = position_y[from]; position_z[to] = position_z[from];
+	rotation_x[to] = rotation_x[from]; rotation_y[to] = rotation_y[from]; rotation_z[to] = rotation_z[from]; rotation_w[to] = rotation_w[from];
+	scale_x[to] = scale_x[from]; scale_y[to] = scale_y[from]; scale_z[to] = scale_z[from];
+	parents[to] = parents[from];
+	world[to] = world[from];
+	handles[to] = handles[from];
+	slots[handles[to]] = to;
+}
+
+void TransformStore::remove(Handle handle) {
+	uint32_t slot = slot_of(handle);
+	uint32_t last = uint32_t(parents.size()) - 1;
+
+	//children move up to this transform's parent (which is still ahead of them):
+	for (uint32_t s = 0; s <= last; ++s) {
+		if (parents[s] == slot) parents[s] = parents[slot];
+	}
+
+	//fill the hole with the last transform:
+	if (slot != last) {
+		move_slot(last, slot);
+		for (uint32_t s = 0; s < last; ++s) {
+			if (parents[s] == last) parents[s] = slot;
+		}
+		//(if the arrays were sorted, 'last' had no children, but its parent may now come after it)
+		if (parents[slot] != None && parents[slot] > slot) needs_sort = true;
+	}
+
+	position_x.pop_back(); position_y.pop_back(); position_z.pop_back();
+	rotation_x.pop_back(); rotation_y.pop_back(); rotation_z.pop_back(); rotation_w.pop_back();
+	scale_x.pop_back(); scale_y.pop_back(); scale_z.pop_back();
+	parents.pop_back();
+	world.pop_back();
+	handles.pop_back();
+
+	slots[handle] = None;
+	free_handles.emplace_back(handle);
+}
+
+void TransformStore::set_parent(Handle handle, Handle parent) {
+	uint32_t slot = slot_of(handle);
+	uint32_t parent_slot = (parent == None ? None : slot_of(parent));
+	for (uint32_t s = parent_slot; s != None; s = parents[s]) {
+		if (s == slot) {
+			throw std::runtime_error("TransformStore: set_parent would create a cycle");
+		}
+	}
+	parents[slot] = parent_slot;
+	if (parent_slot != None && parent_slot > slot) needs_sort = true;
+}
+
+TransformStore::Handle TransformStore::get_parent(Handle handle) const {
+	uint32_t parent_slot = parents[slot_of(handle)];
+	return (parent_slot == None ? None : handles[parent_slot]);
+}
+
+void TransformStore::set_position(Handle handle, glm::vec3 const &position) {
+	uint32_t slot = slot_of(handle);
+	position_x[slot] = position.x; position_y[slot] = position.y; position_z[slot] = position.z;
+}
+
+void TransformStore::set_rotation(Handle handle, glm::quat const &rotation) {
+	uint32_t slot = slot_of(handle);
+	rotation_x[slot] = rotation.x; rotation_y[slot] = rotation.y; rotation_z[slot] = rotation.z; rotation_w[slot] = rotation.w;
+}
+
+void TransformStore::set_scale(Handle handle, glm::vec3 const &scale) {
+	uint32_t slot = slot_of(handle);
+	scale_x[slot] = scale.x; scale_y[slot] = scale.y; scale_z[slot] = scale.z;
+}
+
+glm::vec3 TransformStore::get_position(Handle handle) const {
+	uint32_t slot = slot_of(handle);
+	return glm::vec3(position_x[slot], position_y[slot], position_z[slot]);
+}
+
+glm::quat TransformStore::get_rotation(Handle handle) const {
+	uint32_t slot = slot_of(handle);
+	return glm::quat(rotation_w[slot], rotation_x[slot], rotation_y[slot], rotation_z[slot]); //(constructor is w x y z)
+}
+
+glm::vec3 TransformStore::get_scale(Handle handle) const {
+	uint32_t slot = slot_of(handle);
+	return glm::vec3(scale_x[slot], scale_y[slot], scale_z[slot]);
+}
+
+void TransformStore::sort() {
+	uint32_t count = uint32_t(parents.size());
+
+	//children of each slot, grouped by parent (counting sort; roots are grouped under 'count'):
+	std::vector< uint32_t > first_child(count + 3, 0);
+	for (uint32_t s = 0; s < count; ++s) {
+		first_child[(parents[s] == None ? count : parents[s]) + 2] += 1;
+	}
+	for (uint32_t p = 2; p < count + 2; ++p) {
+		first_child[p + 1] += first_child[p];
+	}
+	std::vector< uint32_t > children(count);
+	for (uint32_t s = 0; s < count; ++s) {
+		children[first_child[(parents[s] == None ? count : parents[s]) + 1]++] = s;
+	}
+	//(now children of p are children[first_child[p]] .. children[first_child[p+1]-1])
+
+	//pre-order traversal from the roots (keeps each subtree contiguous):
+	std::vector< uint32_t > order;
+	order.reserve(count);
+	std::vector< uint32_t > stack;
+	for (uint32_t r = first_child[count + 1]; r > first_child[count]; --r) {
+		stack.emplace_back(children[r - 1]);
+	}
+	while (!stack.empty()) {
+		uint32_t s = stack.back();
+		stack.pop_back();
+		order.emplace_back(s);
+		for (uint32_t c = first_child[s + 1]; c > first_child[s]; --c) {
+			stack.emplace_back(children[c - 1]);
+		}
+	}
+	if (order.size() != count) {
+		throw std::runtime_error("TransformStore: hierarchy contains a cycle");
+	}
+
+	//gather everything into the new order:
+	std::vector< uint32_t > new_slot(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		new_slot[order[i]] = i;
+	}
+	gather(order, &position_x); gather(order, &position_y); gather(order, &position_z);
+	gather(order, &rotation_x); gather(order, &rotation_y); gather(order, &rotation_z); gather(order, &rotation_w);
+	gather(order, &scale_x); gather(order, &scale_y); gather(order, &scale_z);
+	gather(order, &parents);
+	gather(order, &world);
+	gather(order, &handles);
+	for (auto &parent : parents) {
+		if (parent != None) parent = new_slot[parent];
+	}
+	for (uint32_t i = 0; i < count; ++i) {
+		slots[handles[i]] = i;
+	}
+
+	needs_sort = false;
+}
+
+void TransformStore::update() {
+	if (needs_sort) sort();
+
+	uint32_t count = uint32_t(parents.size());
+
+	//pass 1: local TRS -> local-to-parent matrix (stored in 'world', then multiplied in place by pass 2).
+	// same formulas as glm::mat4_cast; columns are rotation columns times scale, then position.
+	uint32_t i = 0;
+#ifdef TRANSFORM_STORE_SSE
+	for (; i + 4 <= count; i += 4) {
+		__m128 x = _mm_loadu_ps(&rotation_x[i]);
+		__m128 y = _mm_loadu_ps(&rotation_y[i]);
+		__m128 z = _mm_loadu_ps(&rotation_z[i]);
+		__m128 w = _mm_loadu_ps(&rotation_w[i]);
+		__m128 one = _mm_set1_ps(1.0f);
+		__m128 two = _mm_set1_ps(2.0f);
+		__m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+		__m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+		__m128 wx = _mm_mul_ps(w, x), wy = _mm_mul_ps(w, y), wz = _mm_mul_ps(w, z);
+
+		__m128 sx = _mm_loadu_ps(&scale_x[i]);
+		__m128 sy = _mm_loadu_ps(&scale_y[i]);
+		__m128 sz = _mm_loadu_ps(&scale_z[i]);
+
+		//column c, row r of four matrices at once:
+		__m128 m[4][4];
+		m[0][0] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), sx);
+		m[0][1] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), sx);
+		m[0][2] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), sx);
+		m[0][3] = _mm_setzero_ps();
+		m[1][0] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), sy);
+		m[1][1] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), sy);
+		m[1][2] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), sy);
+		m[1][3] = _mm_setzero_ps();
+		m[2][0] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), sz);
+		m[2][1] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), sz);
+		m[2][2] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), sz);
+		m[2][3] = _mm_setzero_ps();
+		m[3][0] = _mm_loadu_ps(&position_x[i]);
+		m[3][1] = _mm_loadu_ps(&position_y[i]);
+		m[3][2] = _mm_loadu_ps(&position_z[i]);
+		m[3][3] = one;
+
+		//transpose each column's four rows so each register holds one matrix's column:
+		for (uint32_t c = 0; c < 4; ++c) {
+			_MM_TRANSPOSE4_PS(m[c][0], m[c][1], m[c][2], m[c][3]);
+			for (uint32_t l = 0; l < 4; ++l) {
+				_mm_storeu_ps(&world[i + l][c][0], m[c][l]);
+			}
+		}
+	}
+#endif
+	for (; i < count; ++i) {
+		glm::mat4 r = glm::mat4_cast(get_rotation(handles[i]));
+		world[i] = glm::mat4(
+			r[0] * scale_x[i],
+			r[1] * scale_y[i],
+			r[2] * scale_z[i],
+			glm::vec4(position_x[i], position_y[i], position_z[i], 1.0f)
+		);
+	}
+
+	//pass 2: world = parent's world * local, front to back (a parent's slot is always before its children's):
+	for (i = 0; i < count; ++i) {
+		uint32_t parent = parents[i];
+		if (parent == None) continue;
+#ifdef TRANSFORM_STORE_SSE
+		float const *p = &world[parent][0][0];
+		float *l = &world[i][0][0];
+		__m128 p0 = _mm_loadu_ps(p + 0), p1 = _mm_loadu_ps(p + 4), p2 = _mm_loadu_ps(p + 8), p3 = _mm_loadu_ps(p + 12);
+		__m128 c[4];
+		for (uint32_t j = 0; j < 4; ++j) {
+			c[j] = _mm_add_ps(_mm_add_ps(_mm_add_ps(
+				_mm_mul_ps(p0, _mm_set1_ps(l[4*j+0])),
+				_mm_mul_ps(p1, _mm_set1_ps(l[4*j+1]))),
+				_mm_mul_ps(p2, _mm_set1_ps(l[4*j+2]))),
+				_mm_mul_ps(p3, _mm_set1_ps(l[4*j+3])));
+		}
+		for (uint32_t j = 0; j < 4; ++j) {
+			_mm_storeu_ps(l + 4*j, c[j]);
+		}
+#else
+		world[i] = world[parent] * world[i];
+#endif
+	}
+}
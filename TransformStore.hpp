@@ -0,0 +1,60 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <vector>
+#include <stdint.h>
+
+//"TransformStore" is a flat alternative to Scene::Transform for large hierarchies:
+// local position/rotation/scale live in separate (SoA) arrays, sorted so that parents always precede
+// their children, and update() computes every world matrix in two linear passes:
+//  1) local TRS -> matrix, four transforms at a time (SSE, across the SoA lanes)
+//  2) world[i] = world[parent[i]] * local[i], front to back (parent is always already done)
+// transforms are referred to by handles, which stay valid when the arrays are reordered.
+struct TransformStore {
+	typedef uint32_t Handle;
+	static constexpr Handle None = -1U;
+
+	//add a transform (identity local TRS) as a child of 'parent' (or as a root):
+	Handle add(Handle parent = None);
+
+	//remove a transform; its children are re-parented to its parent (keeping their local TRS):
+	void remove(Handle handle);
+
+	//change parents (local TRS is kept, so the world transform will change):
+	void set_parent(Handle handle, Handle parent);
+	Handle get_parent(Handle handle) const;
+
+	void set_position(Handle handle, glm::vec3 const &position);
+	void set_rotation(Handle handle, glm::quat const &rotation);
+	void set_scale(Handle handle, glm::vec3 const &scale);
+	glm::vec3 get_position(Handle handle) const;
+	glm::quat get_rotation(Handle handle) const;
+	glm::vec3 get_scale(Handle handle) const;
+
+	//recompute all world matrices (re-sorting first if set_parent broke the parents-first order):
+	void update();
+
+	//world matrix as of the last update():
+	glm::mat4 const &local_to_world(Handle handle) const { return world[slots[handle]]; }
+
+	size_t size() const { return parents.size(); }
+
+	//storage, in "slot" order (parents before children):
+	std::vector< float > position_x, position_y, position_z;
+	std::vector< float > rotation_x, rotation_y, rotation_z, rotation_w;
+	std::vector< float > scale_x, scale_y, scale_z;
+	std::vector< uint32_t > parents; //slot of parent, or None for roots
+	std::vector< glm::mat4 > world;
+
+	std::vector< uint32_t > slots; //handle -> slot (None for free handles)
+	std::vector< Handle > handles; //slot -> handle
+	std::vector< Handle > free_handles;
+	bool needs_sort = false;
+
+	//internals:
+	uint32_t slot_of(Handle handle) const; //(checks handle)
+	void sort(); //restore parents-first order
+	void move_slot(uint32_t from, uint32_t to); //copy one slot over another (fixing up handle tables)
+};
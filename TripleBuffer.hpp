@@ -0,0 +1,33 @@
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+//"TripleBuffer" hands values from one writer thread to one reader thread without locks or waiting:
+// the writer fills back() and calls publish(); the reader calls acquire() and then reads front(),
+// the most recently published value (values published in between are skipped).
+// The third buffer is always spare, so the writer never waits for the reader or vice versa.
+// (buffers are reused, so a T holding vectors keeps its allocations)
+template< typename T >
+struct TripleBuffer {
+	//writer side:
+	T &back() { return buffers[back_index]; }
+	void publish() {
+		back_index = middle.exchange(back_index | Fresh, std::memory_order_acq_rel) & Index;
+	}
+
+	//reader side -- returns true if front() changed (a value was published since the last acquire):
+	bool acquire() {
+		if (!(middle.load(std::memory_order_relaxed) & Fresh)) return false;
+		front_index = middle.exchange(front_index, std::memory_order_acq_rel) & Index;
+		return true;
+	}
+	T const &front() const { return buffers[front_index]; }
+
+	//internals:
+	enum : uint32_t { Index = 3, Fresh = 4 };
+	T buffers[3];
+	uint32_t back_index = 0; //(writer's)
+	uint32_t front_index = 1; //(reader's)
+	std::atomic< uint32_t > middle{ 2 }; //spare buffer, | Fresh if it holds a value the reader hasn't taken
+};
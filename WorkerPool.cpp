@@ -0,0 +1,67 @@
+#include "WorkerPool.hpp"
+
+WorkerPool::WorkerPool(uint32_t workers) {
+	for (uint32_t w = 1; w < workers; ++w) {
+		threads.emplace_back(&WorkerPool::worker_loop, this, w);
+	}
+}
+
+WorkerPool::~WorkerPool() {
+	{
+		std::lock_guard< std::mutex > lock(mutex);
+		quit = true;
+	}
+	start.notify_all();
+	for (auto &thread : threads) {
+		thread.join();
+	}
+}
+
+void WorkerPool::run(std::function< void(uint32_t) > const &job_) {
+	{
+		std::lock_guard< std::mutex > lock(mutex);
+		job = &job_;
+		running = uint32_t(threads.size());
+		error = nullptr;
+		generation += 1;
+	}
+	start.notify_all();
+
+	std::exception_ptr caught;
+	try {
+		job_(0);
+	} catch (...) {
+		caught = std::current_exception();
+	}
+
+	std::unique_lock< std::mutex > lock(mutex);
+	done.wait(lock, [this]() { return running == 0; });
+	job = nullptr;
+	if (!caught) caught = error;
+	lock.unlock();
+	if (caught) std::rethrow_exception(caught);
+}
+
+void WorkerPool::worker_loop(uint32_t worker) {
+	uint32_t seen = 0;
+	std::unique_lock< std::mutex > lock(mutex);
+	while (true) {
+		start.wait(lock, [&]() { return quit || generation != seen; });
+		if (quit) return;
+		seen = generation;
+		std::function< void(uint32_t) > const *current = job;
+
+		lock.unlock();
+		std::exception_ptr caught;
+		try {
+			(*current)(worker);
+		} catch (...) {
+			caught = std::current_exception();
+		}
+		lock.lock();
+
+		if (caught && !error) error = caught;
+		running -= 1;
+		if (running == 0) done.notify_one();
+	}
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+//"WorkerPool" keeps a set of threads around so that per-frame parallel work doesn't pay for thread creation:
+struct WorkerPool {
+	//'workers' counts the calling thread, so WorkerPool(1) runs everything inline:
+	explicit WorkerPool(uint32_t workers = std::max(1U, std::thread::hardware_concurrency()));
+	~WorkerPool();
+	WorkerPool(WorkerPool const &) = delete;
+
+	uint32_t size() const { return uint32_t(threads.size()) + 1; }
+
+	//call job(worker) once for each worker in [0, size()) -- worker 0 is the calling thread -- and wait for all of them:
+	// (if any call throws, the first exception is rethrown here once every worker is done)
+	void run(std::function< void(uint32_t) > const &job);
+
+	//internals:
+	void worker_loop(uint32_t worker);
+	std::vector< std::thread > threads;
+	std::mutex mutex;
+	std::condition_variable start; //signalled when a new job is posted (or on quit)
+	std::condition_variable done; //signalled when the last worker finishes a job
+	std::function< void(uint32_t) > const *job = nullptr;
+	uint32_t generation = 0; //incremented for every job
+	uint32_t running = 0; //helper threads still working on the current job
+	std::exception_ptr error;
+	bool quit = false;
+};
+
+//Per-worker task queues with work stealing:
+// each worker takes tasks from the back of its own queue, and, once that is empty,
+// steals from the front of the others' (so thieves take the oldest -- typically largest -- tasks).
+template< typename Task >
+struct StealingQueues {
+	explicit StealingQueues(uint32_t workers) : queues(workers) { }
+
+	void push(uint32_t worker, Task const &task) {
+		std::lock_guard< std::mutex > lock(queues[worker].mutex);
+		queues[worker].tasks.emplace_back(task);
+	}
+
+	//returns false once every queue is empty:
+	bool pop(uint32_t worker, Task *task) {
+		for (uint32_t i = 0; i < queues.size(); ++i) {
+			Queue &queue = queues[(worker + i) % queues.size()];
+			std::lock_guard< std::mutex > lock(queue.mutex);
+			if (queue.tasks.empty()) continue;
+			if (i == 0) {
+				*task = queue.tasks.back();
+				queue.tasks.pop_back();
+			} else {
+				*task = queue.tasks.front();
+				queue.tasks.pop_front();
+			}
+			return true;
+		}
+		return false;
+	}
+
+	struct Queue {
+		std::mutex mutex;
+		std::deque< Task > tasks;
+	};
+	std::vector< Queue > queues;
+};
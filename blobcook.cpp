@@ -0,0 +1,260 @@
+//blobcook converts OBJ/PLY meshes into the meshes.blob (and, optionally, scene.blob) that the game loads.
+// usage: blobcook [--compact] [--threads N] [--scene <scene.blob> [--placements <file.txt>]] <meshes.blob> <in.obj|in.ply>...
+// files are read, triangulated, given normals, and packed in parallel (one mesh or file per task).
+// each line of a placements file is '<mesh name> px py pz qx qy qz qw sx sy sz [parent]' ('#' starts a comment);
+// 'parent' is the index of an earlier placement, relative to which the transform is given.
+// without a placements file, the scene gets one object per mesh at the origin.
+
+#include "MeshBlob.hpp"
+#include "MeshImport.hpp"
+
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+namespace {
+	//run job(0) ... job(count-1) on up to 'threads' threads; rethrows the first exception any job throws:
+	template< typename Job >
+	void parallel_for(uint32_t count, uint32_t threads, Job const &job) {
+		std::atomic< uint32_t > next(0);
+		std::exception_ptr error;
+		std::mutex error_mutex;
+		auto work = [&]() {
+			for (uint32_t i = next++; i < count; i = next++) {
+				try {
+					job(i);
+				} catch (...) {
+					std::lock_guard< std::mutex > lock(error_mutex);
+					if (!error) error = std::current_exception();
+					next = count; //(stop handing out work)
+				}
+			}
+		};
+		std::vector< std::thread > workers;
+		for (uint32_t t = 1; t < std::min(threads, count); ++t) {
+			workers.emplace_back(work);
+		}
+		work();
+		for (auto &worker : workers) worker.join();
+		if (error) std::rethrow_exception(error);
+	}
+
+	bool ends_with(std::string const &str, std::string const &suffix) {
+		if (str.size() < suffix.size()) return false;
+		std::string end = str.substr(str.size() - suffix.size());
+		std::transform(end.begin(), end.end(), end.begin(), ::tolower);
+		return end == suffix;
+	}
+
+	//matches the scn0 and hier entries read by Scene::load:
+	struct SceneEntry {
+		uint32_t name_begin, name_end;
+		glm::vec3 position;
+		glm::quat rotation;
+		glm::vec3 scale;
+	};
+	static_assert(sizeof(SceneEntry) == 48, "Scene entry should be packed");
+
+	struct HierarchyEntry {
+		uint32_t parent = -1U;
+		glm::vec3 position;
+		glm::quat rotation;
+		glm::vec3 scale;
+	};
+	static_assert(sizeof(HierarchyEntry) == 44, "Hierarchy entry should be packed");
+
+	struct Placement {
+		std::string name;
+		SceneEntry world; //(name_begin/name_end are filled in by write_scene)
+		HierarchyEntry local;
+	};
+
+	void write_scene(std::string const &filename, std::vector< Placement > const &objects) {
+		std::vector< char > strings;
+		std::vector< SceneEntry > entries;
+		std::vector< HierarchyEntry > hierarchy;
+		std::unordered_map< std::string, std::pair< uint32_t, uint32_t > > names; //(each name stored once)
+		for (auto const &object : objects) {
+			auto f = names.find(object.name);
+			if (f == names.end()) {
+				uint32_t begin = uint32_t(strings.size());
+				strings.insert(strings.end(), object.name.begin(), object.name.end());
+				f = names.insert(std::make_pair(object.name, std::make_pair(begin, uint32_t(strings.size())))).first;
+			}
+			SceneEntry entry = object.world;
+			entry.name_begin = f->second.first;
+			entry.name_end = f->second.second;
+			entries.emplace_back(entry);
+			hierarchy.emplace_back(object.local);
+		}
+
+		std::ofstream file(filename, std::ios::binary);
+		auto write_chunk = [&](char const *magic, char const *data, size_t size) {
+			uint32_t size32 = uint32_t(size);
+			file.write(magic, 4);
+			file.write(reinterpret_cast< char const * >(&size32), 4);
+			file.write(data, size);
+		};
+		write_chunk("str0", strings.data(), strings.size());
+		write_chunk("scn0", reinterpret_cast< char const * >(entries.data()), entries.size() * sizeof(SceneEntry));
+		write_chunk("hier", reinterpret_cast< char const * >(hierarchy.data()), hierarchy.size() * sizeof(HierarchyEntry));
+		if (!file) {
+			throw std::runtime_error("Failed to write scene blob '" + filename + "'");
+		}
+	}
+
+	std::vector< Placement > read_placements(std::string const &filename) {
+		std::ifstream file(filename);
+		if (!file) {
+			throw std::runtime_error("Failed to open placements file '" + filename + "'");
+		}
+		std::vector< Placement > objects;
+		std::string line;
+		uint32_t line_number = 0;
+		while (std::getline(file, line)) {
+			line_number += 1;
+			size_t hash = line.find('#');
+			if (hash != std::string::npos) line.erase(hash);
+			std::istringstream words(line);
+			std::string name;
+			if (!(words >> name)) continue;
+			Placement placement;
+			placement.name = name;
+			HierarchyEntry &local = placement.local;
+			float q[4];
+			if (!(words >> local.position.x >> local.position.y >> local.position.z
+				>> q[0] >> q[1] >> q[2] >> q[3]
+				>> local.scale.x >> local.scale.y >> local.scale.z)) {
+				throw std::runtime_error(filename + ":" + std::to_string(line_number) + ": expecting '<mesh name> px py pz qx qy qz qw sx sy sz [parent]'");
+			}
+			local.rotation = glm::quat(q[3], q[0], q[1], q[2]); //(constructor is w x y z)
+			int64_t parent;
+			if (words >> parent) {
+				if (parent < 0 || parent >= int64_t(objects.size())) {
+					throw std::runtime_error(filename + ":" + std::to_string(line_number) + ": parent must be the index of an earlier placement");
+				}
+				local.parent = uint32_t(parent);
+			}
+
+			//world placement, for scn0 (exact unless a parent scales non-uniformly under a rotated child):
+			SceneEntry &world = placement.world;
+			if (local.parent == -1U) {
+				world.position = local.position;
+				world.rotation = local.rotation;
+				world.scale = local.scale;
+			} else {
+				SceneEntry const &up = objects[local.parent].world;
+				world.position = up.position + up.rotation * (up.scale * local.position);
+				world.rotation = up.rotation * local.rotation;
+				world.scale = up.scale * local.scale;
+			}
+			objects.emplace_back(placement);
+		}
+		return objects;
+	}
+}
+
+int main(int argc, char **argv) {
+	bool compact = false;
+	uint32_t threads = std::max(1U, std::thread::hardware_concurrency());
+	std::string scene_file, placements_file, meshes_file;
+	std::vector< std::string > inputs;
+
+	auto usage = [&]() {
+		std::cerr << "Usage:\n\t" << argv[0] << " [--compact] [--threads N] [--scene <scene.blob> [--placements <file.txt>]] <meshes.blob> <in.obj|in.ply>..." << std::endl;
+		return 1;
+	};
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--compact") {
+			compact = true;
+		} else if (arg == "--threads" && i + 1 < argc) {
+			threads = uint32_t(std::atoi(argv[++i]));
+			if (threads < 1) return usage();
+		} else if (arg == "--scene" && i + 1 < argc) {
+			scene_file = argv[++i];
+		} else if (arg == "--placements" && i + 1 < argc) {
+			placements_file = argv[++i];
+		} else if (meshes_file.empty()) {
+			meshes_file = arg;
+		} else {
+			inputs.emplace_back(arg);
+		}
+	}
+	if (meshes_file.empty() || inputs.empty() || (!placements_file.empty() && scene_file.empty())) return usage();
+
+	try {
+		auto before = std::chrono::high_resolution_clock::now();
+
+		//read inputs (one file per task):
+		std::vector< std::vector< ImportedMesh > > imported(inputs.size());
+		parallel_for(uint32_t(inputs.size()), threads, [&](uint32_t i) {
+			if (ends_with(inputs[i], ".obj")) imported[i] = import_obj(inputs[i]);
+			else if (ends_with(inputs[i], ".ply")) imported[i] = import_ply(inputs[i]);
+			else throw std::runtime_error("Don't know how to read '" + inputs[i] + "' (expecting .obj or .ply)");
+		});
+		std::vector< ImportedMesh const * > meshes;
+		for (auto const &file : imported) {
+			for (auto const &mesh : file) meshes.emplace_back(&mesh);
+		}
+
+		//triangulate + generate normals + pack vertices (one mesh per task):
+		MeshBlob blob;
+		blob.compact = compact;
+		blob.meshes.resize(meshes.size());
+		parallel_for(uint32_t(meshes.size()), threads, [&](uint32_t m) {
+			cook_mesh(*meshes[m], compact, &blob.meshes[m]);
+		});
+
+		uint64_t vertices = 0;
+		std::unordered_map< std::string, uint32_t > seen;
+		for (auto const &mesh : blob.meshes) {
+			vertices += mesh.vertex_count(blob);
+			if (seen[mesh.name]++ == 1) {
+				std::cerr << "WARNING: more than one mesh named '" << mesh.name << "'; only the first will be found by name." << std::endl;
+			}
+		}
+		blob.save(meshes_file);
+
+		if (!scene_file.empty()) {
+			std::vector< Placement > objects;
+			if (!placements_file.empty()) {
+				objects = read_placements(placements_file);
+				for (auto const &object : objects) {
+					if (!seen.count(object.name)) {
+						std::cerr << "WARNING: placement of '" << object.name << "', which isn't one of the cooked meshes." << std::endl;
+					}
+				}
+			} else {
+				for (auto const &mesh : blob.meshes) {
+					Placement placement;
+					placement.name = mesh.name;
+					placement.world.position = placement.local.position = glm::vec3(0.0f);
+					placement.world.rotation = placement.local.rotation = glm::quat(1.0f, 0.0f, 0.0f, 0.0f);
+					placement.world.scale = placement.local.scale = glm::vec3(1.0f);
+					objects.emplace_back(placement);
+				}
+			}
+			write_scene(scene_file, objects);
+		}
+
+		auto after = std::chrono::high_resolution_clock::now();
+		std::cout << "Cooked " << blob.meshes.size() << " meshes (" << vertices << " vertices) from " << inputs.size() << " files in "
+			<< std::chrono::duration< double >(after - before).count() << " seconds on " << threads << " threads." << std::endl;
+	} catch (std::exception &e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -2,17 +2,19 @@
 #include "GL.hpp"
 #include "Meshes.hpp"
 #include "Scene.hpp"
-#include "read_chunk.hpp"
+#include "TripleBuffer.hpp"
 
 #include <SDL.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include <atomic>
 #include <chrono>
 #include <iostream>
+#include <mutex>
 #include <stdexcept>
-#include <fstream>
+#include <thread>
 
 static GLuint compile_shader(GLenum type, std::string const &source);
 static GLuint link_program(GLuint vertex_shader, GLuint fragment_shader);
@@ -21,18 +23,18 @@ static GLuint link_program(GLuint vertex_shader, GLuint fragment_shader);
 class Balloon {
 public:
 	enum class State {Healthy, Popping, Gone};
-	static Scene::Object* popped;
+	static Scene::ObjectHandle popped;
 	static std::vector<Balloon*> ActiveBalloons;
 
 	float radius = 0.5; //balloon rad is approx 1
-	Scene::Object* object = nullptr;
+	Scene::ObjectHandle object;
 	glm::vec3 vel = glm::vec3(0,0,1);
 	State state = State::Healthy;
 	float elapsed_pop = 0; //only valid when State::Popping. Animate bigger, pop, shrink for black hole effect?
 
 	Balloon(){}
 
-	static Balloon* addBalloon(Scene::Object* object, float radius=1){
+	static Balloon* addBalloon(Scene::ObjectHandle object, float radius=1){
 		Balloon* balloon = (Balloon*) malloc(sizeof(Balloon));
 		*balloon = Balloon(); //call initializer!
 		balloon->radius = radius;
@@ -45,30 +47,32 @@ public:
 		for(auto b : ActiveBalloons) free(b);
 	}
 
-	static void step(float elapsed){
+	static void step(Scene &scene, float elapsed){
 		std::vector<Balloon*>::iterator it = ActiveBalloons.begin();
 		
 
 		while(it != ActiveBalloons.end()){
 			Balloon* balloon = *it;
-			glm::vec3* pos = &(balloon->object->transform.position);
+			Scene::Object &object = scene.objects[balloon->object];
+			Scene::Object &popped_object = scene.objects[popped];
+			glm::vec3 const *pos = &(object.transform.position);
 			switch(balloon->state){
 			case State::Gone:
 				//do nothing. Could reset balloon position here if wanted infinite game
 				break;
 			case State::Healthy:
 				if(pos->z+elapsed*balloon->vel.z > 3 || pos->z+elapsed*balloon->vel.z < balloon->radius) balloon->vel *= -1;
-				*pos += elapsed*balloon->vel;
+				object.transform.set_position(*pos + elapsed*balloon->vel);
 				break;
 			case State::Popping:
 				balloon->elapsed_pop += elapsed;
-				balloon->object->invisible = true;
-				popped->invisible = false;
-				popped->transform.position = balloon->object->transform.position;
+				object.invisible = true;
+				popped_object.invisible = false;
+				popped_object.transform.set_position(object.transform.position);
 				if(balloon->elapsed_pop > 1){
 					balloon->state = State::Gone;
-					balloon->object->invisible = true;
-					popped->invisible = true;
+					object.invisible = true;
+					popped_object.invisible = true;
 					balloon->elapsed_pop = 0;
 				}
 				break;
@@ -87,15 +91,25 @@ public:
 	}
 };
 std::vector<Balloon*> Balloon::ActiveBalloons = std::vector<Balloon*>();
-Scene::Object* Balloon::popped = nullptr;
+Scene::ObjectHandle Balloon::popped;
 
 int main(int argc, char **argv) {
 	//Configuration:
 	struct {
 		std::string title = "Game2: Robot Fun Police";
 		glm::uvec2 size = glm::uvec2(1280, 960);
+		bool threaded = false; //simulate on a separate thread from drawing (--threaded)
 	} config;
 
+	for (int i = 1; i < argc; ++i) {
+		if (std::string(argv[i]) == "--threaded") {
+			config.threaded = true;
+		} else {
+			std::cerr << "Usage:\n\t" << argv[0] << " [--threaded]" << std::endl;
+			return 1;
+		}
+	}
+
 	struct {
 		float base = 0,
 		      low = 0,
@@ -174,24 +188,43 @@ int main(int argc, char **argv) {
 	GLuint program_Position = 0;
 	GLuint program_Normal = 0;
 	GLuint program_Color = 0;
-	GLuint program_mvp = 0;
-	GLuint program_itmv = 0;
 	GLuint program_to_light = 0;
-	{ //compile shader program:
-		GLuint vertex_shader = compile_shader(GL_VERTEX_SHADER,
-			"#version 330\n"
-			"uniform mat4 mvp;\n"
-			"uniform mat3 itmv;\n"
-			"in vec4 Position;\n"
-			"in vec3 Normal;\n"
-			"in vec3 Color;\n"
+	//variant for compact (quantized position, octahedral normal) meshes:
+	GLuint compact_program = 0;
+	GLuint compact_program_NormalOct = 0;
+	GLuint compact_program_to_light = 0;
+
+	GLuint query_program = 0; //(draws bounding boxes for Scene's occlusion queries)
+	{ //compile shader programs:
+		//attribute locations are fixed so that one set of mesh VAOs works with both programs:
+		std::string vertex_source =
+			"layout(location = 0) in vec4 Position;\n"
+			"layout(location = 2) in vec3 Color;\n"
+			"struct Instance { mat4 mvp; mat3 itmv; };\n" //per-object constants (see Scene::render)
+			"layout(std140) uniform Instances { Instance instances[" + std::to_string(Scene::InstancesPerBlock) + "]; };\n"
 			"out vec3 normal;\n"
 			"out vec3 color;\n"
 			"void main() {\n"
-			"	gl_Position = mvp * Position;\n"
-			"	normal = itmv * Normal;\n"
+			"	gl_Position = instances[gl_InstanceID].mvp * Position;\n"
+			"	normal = instances[gl_InstanceID].itmv * decode_normal();\n"
 			"	color = Color;\n"
 			"}\n"
+		;
+		GLuint vertex_shader = compile_shader(GL_VERTEX_SHADER,
+			"#version 330\n"
+			"layout(location = 1) in vec3 Normal;\n"
+			"vec3 decode_normal() { return Normal; }\n"
+			+ vertex_source
+		);
+		GLuint compact_vertex_shader = compile_shader(GL_VERTEX_SHADER,
+			"#version 330\n"
+			"layout(location = 3) in vec2 NormalOct;\n"
+			"vec3 decode_normal() {\n" //octahedral decode
+			"	vec3 n = vec3(NormalOct, 1.0 - abs(NormalOct.x) - abs(NormalOct.y));\n"
+			"	if (n.z < 0.0) n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);\n"
+			"	return normalize(n);\n"
+			"}\n"
+			+ vertex_source
 		);
 
 		GLuint fragment_shader = compile_shader(GL_FRAGMENT_SHADER,
@@ -207,6 +240,29 @@ int main(int argc, char **argv) {
 		);
 
 		program = link_program(fragment_shader, vertex_shader);
+		compact_program = link_program(fragment_shader, compact_vertex_shader);
+
+		//occlusion query boxes: box i is the unit cube, as a 14-vertex triangle strip starting at vertex 14 * i:
+		GLuint query_vertex_shader = compile_shader(GL_VERTEX_SHADER,
+			"#version 330\n"
+			"layout(std140) uniform Boxes { mat4 boxes[" + std::to_string(Scene::BoxesPerBlock) + "]; };\n" //(see Scene::query_program)
+			"void main() {\n"
+			"	int bit = 1 << (gl_VertexID % 14);\n" //strip corners, one bit per vertex per axis
+			"	vec3 corner = vec3((0x287a & bit) != 0, (0x02af & bit) != 0, (0x31e3 & bit) != 0);\n"
+			"	gl_Position = boxes[gl_VertexID / 14] * vec4(corner, 1.0);\n"
+			"}\n"
+		);
+		GLuint query_fragment_shader = compile_shader(GL_FRAGMENT_SHADER,
+			"#version 330\n"
+			"out vec4 fragColor;\n"
+			"void main() {\n"
+			"	fragColor = vec4(1.0);\n" //(color writes are masked off while queries draw)
+			"}\n"
+		);
+		query_program = link_program(query_fragment_shader, query_vertex_shader);
+		GLuint boxes = glGetUniformBlockIndex(query_program, "Boxes");
+		if (boxes == GL_INVALID_INDEX) throw std::runtime_error("no uniform block named Boxes");
+		glUniformBlockBinding(query_program, boxes, Scene::InstancesBinding);
 
 		//look up attribute locations:
 		program_Position = glGetAttribLocation(program, "Position");
@@ -217,14 +273,22 @@ int main(int argc, char **argv) {
 		program_Color = glGetAttribLocation(program, "Color");
 		if (program_Color == -1U) throw std::runtime_error("no attribute named Color");
 
-		//look up uniform locations:
-		program_mvp = glGetUniformLocation(program, "mvp");
-		if (program_mvp == -1U) throw std::runtime_error("no uniform named mvp");
-		program_itmv = glGetUniformLocation(program, "itmv");
-		if (program_itmv == -1U) throw std::runtime_error("no uniform named itmv");
+		compact_program_NormalOct = glGetAttribLocation(compact_program, "NormalOct");
+		if (compact_program_NormalOct == -1U) throw std::runtime_error("no attribute named NormalOct");
 
+		//per-object constants come from Scene's uniform ring:
+		for (GLuint p : {program, compact_program}) {
+			GLuint instances = glGetUniformBlockIndex(p, "Instances");
+			if (instances == GL_INVALID_INDEX) throw std::runtime_error("no uniform block named Instances");
+			glUniformBlockBinding(p, instances, Scene::InstancesBinding);
+		}
+
+		//look up uniform locations:
 		program_to_light = glGetUniformLocation(program, "to_light");
 		if (program_to_light == -1U) throw std::runtime_error("no uniform named to_light");
+
+		compact_program_to_light = glGetUniformLocation(compact_program, "to_light");
+		if (compact_program_to_light == -1U) throw std::runtime_error("no uniform named to_light");
 	}
 
 	//------------ meshes ------------
@@ -236,6 +300,7 @@ int main(int argc, char **argv) {
 		attributes.Position = program_Position;
 		attributes.Normal = program_Normal;
 		attributes.Color = program_Color;
+		attributes.NormalOct = compact_program_NormalOct;
 
 		meshes.load("meshes.blob", attributes);
 	}
@@ -243,86 +308,51 @@ int main(int argc, char **argv) {
 	//------------ scene ------------
 
 	Scene scene;
+	WorkerPool workers; //(scene.render spreads transform updates, culling, and draw packet building across these)
 	//set up camera parameters based on window:
 	scene.camera.fovy = glm::radians(60.0f);
 	scene.camera.aspect = float(config.size.x) / float(config.size.y);
 	scene.camera.near = 0.01f;
 	//(transform will be handled in the update function below)
 
-	//add some objects from the mesh library:
-	auto add_object = [&](std::string const &name, glm::vec3 const &position, glm::quat const &rotation, glm::vec3 const &scale) -> Scene::Object* {
-		Mesh const &mesh = meshes.get(name);
-		scene.objects.emplace_back();
-		Scene::Object &object = scene.objects.back();
-		object.transform.position = position;
-		object.transform.rotation = rotation;
-		object.transform.scale = scale;
-		object.vao = mesh.vao;
-		object.start = mesh.start;
-		object.count = mesh.count;
-		object.program = program;
-		object.program_mvp = program_mvp;
-		object.program_itmv = program_itmv;
-		object.name = name;
-		return &object;
+	//objects made from meshes get these programs:
+	scene.mesh_program = program;
+	scene.compact_mesh_program = compact_program;
+	scene.query_program = query_program;
+
+	auto transform = [&](Scene::ObjectHandle handle) -> Scene::Transform & {
+		return scene.objects[handle].transform;
 	};
 
-	Scene::Transform *stand,*base,*link1,*link2,*link3,*tip;
-	{ //read objects to add from "scene.blob":
-		std::ifstream file("scene.blob", std::ios::binary);
-
-		std::vector< char > strings;
-		//read strings chunk:
-		read_chunk(file, "str0", &strings);
-
-		{ //read scene chunk, add meshes to scene:
-			struct SceneEntry {
-				uint32_t name_begin, name_end;
-				glm::vec3 position;
-				glm::quat rotation;
-				glm::vec3 scale;
-			};
-			static_assert(sizeof(SceneEntry) == 48, "Scene entry should be packed");
-
-			std::vector< SceneEntry > data;
-			read_chunk(file, "scn0", &data);
-
-			for (auto const &entry : data) {
-				if (!(entry.name_begin <= entry.name_end && entry.name_end <= strings.size())) {
-					throw std::runtime_error("index entry has out-of-range name begin/end");
-				}
-				std::string name(&strings[0] + entry.name_begin, &strings[0] + entry.name_end);
-				add_object(name, entry.position, entry.rotation, entry.scale);
-				if(name.substr(0,7) == "Balloon"){
-					Balloon::addBalloon(&scene.objects.back());
-				}
-			}
+	Scene::ObjectHandle base,link1,link2,link3,tip;
+	{ //read objects to add from "scene.blob" (the robot's hierarchy comes from its "hier" chunk):
+		scene.load("scene.blob", meshes);
+		std::vector< Scene::ObjectHandle > balloons;
+		scene.find_prefix("Balloon", &balloons);
+		for (auto balloon : balloons) {
+			Balloon::addBalloon(balloon);
 		}
 
-		{//setup hierarchy
-			stand=base=link1=link2=link3=tip=nullptr;
-			for (auto & obj : scene.objects){
-				if(obj.name == std::string("Stand")) stand = &obj.transform;
-				if(obj.name == std::string("Base")) base = &obj.transform;
-				if(obj.name == std::string("Link1")) link1 = &obj.transform;
-				if(obj.name == std::string("Link2")) link2 = &obj.transform;
-				if(obj.name == std::string("Link3")) link3 = &obj.transform;
-				if(obj.name == std::string("Tip")) tip = &obj.transform;
-			}
-			tip->set_parent(link3);tip->position -= link3->position;
-			link3->set_parent(link2);link3->position -= link2->position;
-			link2->set_parent(link1);link2->position -= link1->position;
-			link1->set_parent(base);link1->position -= base->position;
-			base->set_parent(stand);base->position -= stand->position;
+		//crates and the floor are solid, so they can hide things (see Scene::occlusion_culling):
+		std::vector< Scene::ObjectHandle > occluders;
+		scene.find_prefix("Crate", &occluders);
+		occluders.emplace_back(scene.find("Floor"));
+		for (auto occluder : occluders) {
+			if (Scene::Object *object = scene.objects.get(occluder)) object->occluder = true;
 		}
 
-		//balloon popping
-		add_object(std::string("Balloon1-Pop"), glm::vec3(0,0,0), glm::quat(0,0,0,0), glm::vec3(1,1,1));
-		Balloon::popped = &scene.objects.back();
-		Balloon::popped->invisible = true;
-		
+		//find robot parts:
+		base = scene.find("Base");
+		link1 = scene.find("Link1");
+		link2 = scene.find("Link2");
+		link3 = scene.find("Link3");
+		tip = scene.find("Tip");
+		//(scene.objects[] throws later if any of these weren't found)
 
-		
+		//balloon popping
+		Balloon::popped = scene.add_object(meshes, meshes.lookup("Balloon1-Pop"));
+		transform(Balloon::popped).set_rotation(glm::quat(0,0,0,0));
+		scene.objects[Balloon::popped].invisible = true;
 	}
 
 	glm::vec2 mouse = glm::vec2(0.0f, 0.0f); //mouse position in [-1,1]x[-1,1] coordinates
@@ -336,8 +366,15 @@ int main(int argc, char **argv) {
 		
 	//------------ game loop ------------
 
-	bool should_quit = false;
-	while (true) {
+	std::atomic< bool > should_quit(false);
+	Scene::RenderStats render_totals; //(summed over frames; reported at exit)
+	uint32_t frames = 0;
+
+	//events change the controls (robotState, camera, mouse) that simulate reads:
+	// (in --threaded mode these run on different threads, so each holds controls_mutex)
+	std::mutex controls_mutex;
+
+	auto handle_events = [&]() {
 		//handle events
 		static SDL_Event evt;
 		while (SDL_PollEvent(&evt) == 1) {
@@ -395,63 +432,63 @@ int main(int argc, char **argv) {
 				break;
 			}
 		}
-		if (should_quit) break;
-
+	};
 
-		//update timers
-		auto current_time = std::chrono::high_resolution_clock::now();
-		static auto previous_time = current_time;
-		float elapsed = std::chrono::duration< float >(current_time - previous_time).count();
-		previous_time = current_time;
-		static float fulltime = 0;
+	//advance the game by 'elapsed' seconds -- changes scene transforms and visibility, but never GL state:
+	float fulltime = 0.0f;
+	auto simulate = [&](float elapsed) {
 		fulltime += elapsed;
 
-		{ //update game state
-			//manage balloons
-			Balloon::step(elapsed);
-
-			//update robot pos based on rotations:
-			base->rotation = glm::angleAxis(robotState.base,glm::vec3(0,0,1));
-			link1->rotation = glm::angleAxis(robotState.low,glm::vec3(1,0,0));
-			link2->rotation = glm::angleAxis(robotState.mid,glm::vec3(1,0,0));
-			link3->rotation = glm::angleAxis(robotState.high,glm::vec3(1,0,0));
-
-			//manage collisions
-			glm::vec4 tipposh = tip->make_local_to_world()*glm::vec4(tip->position,1);
-			glm::vec3 tippos = glm::vec3(tipposh.x,tipposh.y,tipposh.z)/tipposh.w;
-			for(Balloon* balloon : Balloon::ActiveBalloons){
-				if(glm::length(balloon->object->transform.position - tippos) < balloon->radius) balloon->pop();
-			}
+		//manage balloons
+		Balloon::step(scene, elapsed);
 
-			if(Balloon::gameOver()){
-				static float delay = 0;
-				static float endtime = fulltime;
-				delay += elapsed;
-				if(delay > 2){
-					printf("Congratulations! Your total time was %.2f!\n",endtime);
-					Balloon::freeBalloons();
-					should_quit = true;
-				}
-			}
+		//update robot pos based on rotations:
+		transform(base).set_rotation(glm::angleAxis(robotState.base,glm::vec3(0,0,1)));
+		transform(link1).set_rotation(glm::angleAxis(robotState.low,glm::vec3(1,0,0)));
+		transform(link2).set_rotation(glm::angleAxis(robotState.mid,glm::vec3(1,0,0)));
+		transform(link3).set_rotation(glm::angleAxis(robotState.high,glm::vec3(1,0,0)));
 
+		//manage collisions
+		glm::vec4 tipposh = transform(tip).make_local_to_world()*glm::vec4(transform(tip).position,1);
+		glm::vec3 tippos = glm::vec3(tipposh.x,tipposh.y,tipposh.z)/tipposh.w;
+		for(Balloon* balloon : Balloon::ActiveBalloons){
+			if(glm::length(transform(balloon->object).position - tippos) < balloon->radius) balloon->pop();
+		}
 
-			//camera
-			scene.camera.transform.position = camera.radius * glm::vec3(
-				std::cos(camera.elevation) * std::cos(camera.azimuth),
-				std::cos(camera.elevation) * std::sin(camera.azimuth),
-				std::sin(camera.elevation)) + camera.target;
-
-			glm::vec3 out = -glm::normalize(camera.target - scene.camera.transform.position);
-			glm::vec3 up = glm::vec3(0.0f, 0.0f, 1.0f);
-			up = glm::normalize(up - glm::dot(up, out) * out);
-			glm::vec3 right = glm::cross(up, out);
-			
-			scene.camera.transform.rotation = glm::quat_cast(
-				glm::mat3(right, up, out)
-			);
-			scene.camera.transform.scale = glm::vec3(1.0f, 1.0f, 1.0f);
+		if(Balloon::gameOver()){
+			static float delay = 0;
+			static float endtime = fulltime;
+			delay += elapsed;
+			if(delay > 2){
+				printf("Congratulations! Your total time was %.2f!\n",endtime);
+				Balloon::freeBalloons();
+				should_quit = true;
+			}
 		}
 
+
+		//camera
+		scene.camera.transform.set_position(camera.radius * glm::vec3(
+			std::cos(camera.elevation) * std::cos(camera.azimuth),
+			std::cos(camera.elevation) * std::sin(camera.azimuth),
+			std::sin(camera.elevation)) + camera.target);
+
+		glm::vec3 out = -glm::normalize(camera.target - scene.camera.transform.position);
+		glm::vec3 up = glm::vec3(0.0f, 0.0f, 1.0f);
+		up = glm::normalize(up - glm::dot(up, out) * out);
+		glm::vec3 right = glm::cross(up, out);
+		
+		scene.camera.transform.set_rotation(glm::quat_cast(
+			glm::mat3(right, up, out)
+		));
+		scene.camera.transform.set_scale(glm::vec3(1.0f, 1.0f, 1.0f));
+	};
+
+	//draw the scene (from 'snapshot', if given -- see Scene::render) and wait for the swap:
+	auto draw = [&](Scene::Snapshot const *snapshot) {
+		//continue any background (Meshes::load_async) mesh uploads:
+		meshes.update_uploads();
+
 		//draw output
 		glClearColor(0.5, 0.5, 0.5, 0.0);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -461,16 +498,96 @@ int main(int argc, char **argv) {
 
 
 		{ //draw game state
+			glm::vec3 to_light = glm::normalize(glm::vec3(0.0f, 1.0f, 10.0f));
 			glUseProgram(program);
-			glUniform3fv(program_to_light, 1, glm::value_ptr(glm::normalize(glm::vec3(0.0f, 1.0f, 10.0f))));
-			scene.render();
+			glUniform3fv(program_to_light, 1, glm::value_ptr(to_light));
+			glUseProgram(compact_program);
+			glUniform3fv(compact_program_to_light, 1, glm::value_ptr(to_light));
+			scene.render(&workers, snapshot);
+			render_totals.cull_tested += scene.render_stats.cull_tested;
+			render_totals.cull_culled += scene.render_stats.cull_culled;
+			render_totals.occlusion_culled += scene.render_stats.occlusion_culled;
+			render_totals.queries += scene.render_stats.queries;
+			render_totals.query_hidden += scene.render_stats.query_hidden;
+			render_totals.draws += scene.render_stats.draws;
+			render_totals.draw_calls += scene.render_stats.draw_calls;
+			render_totals.program_binds += scene.render_stats.program_binds;
+			render_totals.vao_binds += scene.render_stats.vao_binds;
+			render_totals.unsorted_binds += scene.render_stats.unsorted_binds;
+			frames += 1;
 		}
 
-
 		SDL_GL_SwapWindow(window);
+	};
+
+	if (!config.threaded) {
+		//one thread does everything, in order:
+		while (true) {
+			handle_events();
+			if (should_quit) break;
+
+			//update timers
+			auto current_time = std::chrono::high_resolution_clock::now();
+			static auto previous_time = current_time;
+			float elapsed = std::chrono::duration< float >(current_time - previous_time).count();
+			previous_time = current_time;
+
+			simulate(elapsed);
+			draw(nullptr);
+		}
+	} else {
+		//simulation runs on its own thread in fixed steps, publishing a snapshot after each;
+		// this thread handles events and draws the latest snapshot (so waiting in SDL_GL_SwapWindow never delays simulation):
+		// (objects must not be added or removed from here on -- snapshots hold them by index)
+		const std::chrono::duration< float > SimulationStep(1.0f / 120.0f);
+		TripleBuffer< Scene::Snapshot > snapshots;
+		scene.snapshot(snapshots.back());
+		snapshots.publish();
+
+		std::thread simulation([&]() {
+			auto next_step = std::chrono::high_resolution_clock::now();
+			while (!should_quit) {
+				next_step += std::chrono::duration_cast< std::chrono::high_resolution_clock::duration >(SimulationStep);
+				auto now = std::chrono::high_resolution_clock::now();
+				if (now < next_step) {
+					std::this_thread::sleep_until(next_step);
+				} else if (now - next_step > 10 * SimulationStep) {
+					next_step = now; //(far behind -- e.g., after a debugger pause -- so drop the missed steps)
+				}
+				{
+					std::lock_guard< std::mutex > lock(controls_mutex);
+					simulate(SimulationStep.count());
+				}
+				scene.snapshot(snapshots.back());
+				snapshots.publish();
+			}
+		});
+
+		while (!should_quit) {
+			{
+				std::lock_guard< std::mutex > lock(controls_mutex);
+				handle_events();
+			}
+			if (should_quit) break;
+			snapshots.acquire();
+			draw(&snapshots.front());
+		}
+		should_quit = true;
+		simulation.join();
 	}
 
 
+	if (frames) {
+		std::cout << "Per frame: " << float(render_totals.cull_culled) / frames << " of " << float(render_totals.cull_tested) / frames << " objects frustum culled, "
+			<< float(render_totals.occlusion_culled) / frames << " occlusion culled, "
+			<< float(render_totals.queries) / frames << " occlusion queries ("
+			<< float(render_totals.query_hidden) / frames << " objects drawn conditionally), "
+			<< float(render_totals.draws) / frames << " objects in "
+			<< float(render_totals.draw_calls) / frames << " draw calls, "
+			<< float(render_totals.program_binds + render_totals.vao_binds) / frames << " program/vao binds ("
+			<< float(render_totals.binds_saved()) / frames << " saved by sorting draws by state)." << std::endl;
+	}
+
 	//------------  teardown ------------
 
 	SDL_GL_DeleteContext(context);
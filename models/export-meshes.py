@@ -3,15 +3,38 @@
 #based on 'export-sprites.py' and 'glsprite.py' from TCHOW Rainbow; code used is released into the public domain.
 
 #Note: Script meant to be executed from within blender, as per:
-#blender --background --python export-meshes.py
+#blender --background --python export-meshes.py [-- --compact]
 
 #reads 'island.blend' and writes '../dist/meshes.blob' (meshes) and '../dist/scene.blob' (scene in layer 1)
+#with '--compact', meshes are written as q3n2c4 (16 bytes/vertex) instead of v3n3c3 (36 bytes/vertex)
 
 import sys
 
 import bpy
 import struct
 
+args = sys.argv[sys.argv.index('--')+1:] if '--' in sys.argv else []
+compact = ('--compact' in args)
+
+#pack helpers for the compact format:
+def quantize_unorm16(x, lo, hi):
+	if hi <= lo: return 0
+	return max(0, min(65535, int(round((x - lo) / (hi - lo) * 65535.0))))
+
+def quantize_snorm16(x):
+	return max(-32767, min(32767, int(round(x * 32767.0))))
+
+def encode_octahedral(n):
+	l = abs(n[0]) + abs(n[1]) + abs(n[2])
+	if l == 0.0: return (0, 0)
+	x, y, z = n[0] / l, n[1] / l, n[2] / l
+	if z < 0.0:
+		x, y = (1.0 - abs(y)) * (1.0 if x >= 0.0 else -1.0), (1.0 - abs(x)) * (1.0 if y >= 0.0 else -1.0)
+	return (quantize_snorm16(x), quantize_snorm16(y))
+
+def quantize_unorm8(x):
+	return max(0, min(255, int(round(x * 255.0))))
+
 bpy.ops.wm.open_mainfile(filepath='robot.blend')
 
 #names of objects whose meshes to write (not actually the names of the meshes):
@@ -25,6 +48,12 @@ strings = b''
 #index gives offsets into the data (and names) for each mesh:
 index = b''
 
+#bounds gives each mesh's bounding box and sphere (min, max, center, radius):
+bounds = b''
+
+#(name_begin, name_end, vertex_start, vertex_count) for each mesh, for the toc:
+toc_meshes = []
+
 vertex_count = 0
 for name in to_write:
 	print("Writing '" + name + "'...")
@@ -60,11 +89,13 @@ for name in to_write:
 
 	index += struct.pack('I', vertex_count)
 	index += struct.pack('I', len(mesh.polygons) * 3)
+	toc_meshes.append((name_begin, name_end, vertex_count, len(mesh.polygons) * 3))
 	try:
 		colors = mesh.vertex_colors.active.data
 	except:
 		colors = None
-	#write the mesh:
+	#gather the mesh's (position, normal, color) triangle soup:
+	verts = []
 	for poly in mesh.polygons:
 		assert(len(poly.loop_indices) == 3)
 		for i in range(0,3):
@@ -72,38 +103,70 @@ for name in to_write:
 			loop = mesh.loops[poly.loop_indices[i]]
 			if(colors is not None):
 				color = colors[poly.loop_indices[i]].color
-			vertex = mesh.vertices[loop.vertex_index]
-			for x in mesh.vertices[loop.vertex_index].co:
-				data += struct.pack('f', x)
-			for x in loop.normal:
-				data += struct.pack('f', x)
-			if(colors is None):
-				data += struct.pack('f',1)
-				data += struct.pack('f',1)
-				data += struct.pack('f',1)
+				color = (color.r, color.g, color.b)
 			else:
-				data += struct.pack('f',color.r)
-				data += struct.pack('f',color.g)
-				data += struct.pack('f',color.b)
+				color = (1.0, 1.0, 1.0)
+			verts.append((tuple(mesh.vertices[loop.vertex_index].co), tuple(loop.normal), color))
+	#bounding box, and a sphere around its center:
+	lo = [min(v[0][c] for v in verts) for c in range(0,3)] if verts else [0.0, 0.0, 0.0]
+	hi = [max(v[0][c] for v in verts) for c in range(0,3)] if verts else [0.0, 0.0, 0.0]
+	center = [0.5 * (lo[c] + hi[c]) for c in range(0,3)]
+	radius = max([sum((v[0][c] - center[c]) ** 2 for c in range(0,3)) ** 0.5 for v in verts] + [0.0])
+	bounds += struct.pack('3f', *lo)
+	bounds += struct.pack('3f', *hi)
+	bounds += struct.pack('3f', *center)
+	bounds += struct.pack('f', radius)
+	#write the mesh:
+	if compact:
+		index += struct.pack('3f', *lo)
+		index += struct.pack('3f', *hi)
+		for (co, normal, color) in verts:
+			data += struct.pack('4H', quantize_unorm16(co[0], lo[0], hi[0]), quantize_unorm16(co[1], lo[1], hi[1]), quantize_unorm16(co[2], lo[2], hi[2]), 0)
+			data += struct.pack('2h', *encode_octahedral(normal))
+			data += struct.pack('4B', quantize_unorm8(color[0]), quantize_unorm8(color[1]), quantize_unorm8(color[2]), 255)
+	else:
+		for (co, normal, color) in verts:
+			data += struct.pack('3f', *co)
+			data += struct.pack('3f', *normal)
+			data += struct.pack('3f', *color)
 	vertex_count += len(mesh.polygons) * 3
 
-#check that we wrote as much data as anticipated:
-assert(vertex_count * (3 * 4 + 3 * 4 + 3*4) == len(data))
+vertex_size = (16 if compact else 3 * 4 + 3 * 4 + 3*4)
 
-#write the data chunk and index chunk to an output blob:
+#check that we wrote as much data as anticipated:
+assert(vertex_count * vertex_size == len(data))
+
+#table of contents: lets the game find any chunk or mesh without reading what comes before it
+# (header: chunk count, mesh count; then (magic, header offset, size) per chunk; then per-mesh entries)
+if compact:
+	chunks = [(b'q3n2', data), (b'str0', strings), (b'idq0', index), (b'bnd0', bounds)]
+else:
+	chunks = [(b'v3n3', data), (b'str0', strings), (b'idx0', index), (b'bnd0', bounds)]
+toc_size = 8 + 12 * len(chunks) + 24 * len(toc_meshes)
+offsets = []
+offset = 8 + toc_size #first chunk after the toc chunk
+for (magic, payload) in chunks:
+	offsets.append(offset)
+	offset += 8 + len(payload)
+toc = struct.pack('II', len(chunks), len(toc_meshes))
+for ((magic, payload), offset) in zip(chunks, offsets):
+	toc += struct.pack('4sII', magic, offset, len(payload))
+for (name_begin, name_end, vertex_start, vertex_count) in toc_meshes:
+	toc += struct.pack('IIII', name_begin, name_end, vertex_start, vertex_count)
+	toc += struct.pack('II', offsets[0] + 8 + vertex_start * vertex_size, vertex_count * vertex_size)
+assert(len(toc) == toc_size)
+
+#write the toc, data chunk and index chunk to an output blob:
 blob = open('../dist/meshes.blob', 'wb')
-#first chunk: the data
-blob.write(struct.pack('4s',b'v3n3')) #type
-blob.write(struct.pack('I', len(data))) #length
-blob.write(data)
-#second chunk: the strings
-blob.write(struct.pack('4s',b'str0')) #type
-blob.write(struct.pack('I', len(strings))) #length
-blob.write(strings)
-#third chunk: the index
-blob.write(struct.pack('4s',b'idx0')) #type
-blob.write(struct.pack('I', len(index))) #length
-blob.write(index)
+#zeroth chunk: the table of contents
+blob.write(struct.pack('4s',b'toc0')) #type
+blob.write(struct.pack('I', len(toc))) #length
+blob.write(toc)
+#then: the data, the strings, the index, and the bounds
+for (magic, payload) in chunks:
+	blob.write(struct.pack('4s',magic)) #type
+	blob.write(struct.pack('I', len(payload))) #length
+	blob.write(payload)
 
 print("Wrote " + str(blob.tell()) + " bytes to meshes.blob")
 
@@ -124,13 +187,19 @@ for name in to_write:
 	strings += bytes(name, 'utf8')
 	name_end[mesh_name] = len(strings)
 
+#the robot arm isn't parented in robot.blend, so it gets these parents (by object name) if blender gives none:
+# (as the game used to set up by hand, these children keep their world rotation and scale, and store their position relative to the parent's)
+default_parents = {"Base":"Stand", "Link1":"Base", "Link2":"Link1", "Link3":"Link2", "Tip":"Link3"}
+
 #scene chunk will have transforms + indices into strings for name
 scene = b''
+written = []
 for obj in bpy.data.objects:
 	if obj.layers[0] == False: continue
 	if not obj.data.name in name_begin:
 		print("WARNING: not writing object '" + obj.name + "' because mesh not written.")
 		continue
+	written.append(obj)
 	scene += struct.pack('I', name_begin[obj.data.name])
 	scene += struct.pack('I', name_end[obj.data.name])
 	transform = obj.matrix_world.decompose()
@@ -138,6 +207,27 @@ for obj in bpy.data.objects:
 	scene += struct.pack('4f', transform[1].x, transform[1].y, transform[1].z, transform[1].w)
 	scene += struct.pack('3f', transform[2].x, transform[2].y, transform[2].z)
 
+#hierarchy chunk has (parent index or -1, parent-relative transform) for each scene entry:
+index_of = dict((obj.name, i) for (i, obj) in enumerate(written))
+hierarchy = b''
+for obj in written:
+	parent = -1
+	if obj.parent is not None and obj.parent.name in index_of:
+		parent = index_of[obj.parent.name]
+		transform = (obj.parent.matrix_world.inverted() * obj.matrix_world).decompose()
+		position = transform[0]
+	elif obj.name in default_parents and default_parents[obj.name] in index_of:
+		parent = index_of[default_parents[obj.name]]
+		transform = obj.matrix_world.decompose()
+		position = transform[0] - written[parent].matrix_world.decompose()[0]
+	else:
+		transform = obj.matrix_world.decompose()
+		position = transform[0]
+	hierarchy += struct.pack('I', parent & 0xffffffff)
+	hierarchy += struct.pack('3f', position.x, position.y, position.z)
+	hierarchy += struct.pack('4f', transform[1].x, transform[1].y, transform[1].z, transform[1].w)
+	hierarchy += struct.pack('3f', transform[2].x, transform[2].y, transform[2].z)
+
 #write the strings chunk and scene chunk to an output blob:
 blob = open('../dist/scene.blob', 'wb')
 #first chunk: the strings
@@ -148,6 +238,10 @@ blob.write(strings)
 blob.write(struct.pack('4s',b'scn0')) #type
 blob.write(struct.pack('I', len(scene))) #length
 blob.write(scene)
+#third chunk: the hierarchy
+blob.write(struct.pack('4s',b'hier')) #type
+blob.write(struct.pack('I', len(hierarchy))) #length
+blob.write(hierarchy)
 
 print("Wrote " + str(blob.tell()) + " bytes to scene.blob")
 
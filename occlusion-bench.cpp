@@ -0,0 +1,151 @@
+//occlusion-bench measures OcclusionBuffer on a synthetic dense scene (no window or GL needed):
+// usage: occlusion-bench [objects] [max threads]
+// a wall of crates (with some gaps) stands in front of the camera, with many small objects scattered in front of
+// and behind it. Reports how many objects are culled, the overdraw (summed screen area of drawn objects' boxes, in
+// screens) with and without culling, and rasterize/test times with 1 .. N threads. Results must not depend on the thread count.
+
+#include "OcclusionBuffer.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+
+namespace {
+	struct Box {
+		glm::vec3 min, max;
+	};
+
+	//fraction of the screen covered by a box's screen rectangle (an overdraw estimate):
+	float screen_area(glm::mat4 const &world_to_clip, Box const &box) {
+		glm::vec2 lo(1.0f), hi(-1.0f);
+		for (int i = 0; i < 8; ++i) {
+			glm::vec4 clip = world_to_clip * glm::vec4((i & 1) ? box.max.x : box.min.x, (i & 2) ? box.max.y : box.min.y, (i & 4) ? box.max.z : box.min.z, 1.0f);
+			glm::vec2 ndc = glm::vec2(clip.x, clip.y) / clip.w;
+			lo = glm::min(lo, ndc);
+			hi = glm::max(hi, ndc);
+		}
+		glm::vec2 size = glm::clamp(hi, -1.0f, 1.0f) - glm::clamp(lo, -1.0f, 1.0f);
+		return std::max(0.0f, size.x) * std::max(0.0f, size.y) / 4.0f;
+	}
+
+	double seconds_since(std::chrono::high_resolution_clock::time_point before) {
+		return std::chrono::duration< double >(std::chrono::high_resolution_clock::now() - before).count();
+	}
+}
+
+int main(int argc, char **argv) {
+	uint32_t count = 100000;
+	uint32_t max_threads = std::max(1U, std::thread::hardware_concurrency());
+	if (argc > 1) count = uint32_t(std::atoi(argv[1]));
+	if (argc > 2) max_threads = uint32_t(std::max(1, std::atoi(argv[2])));
+	if (count == 0) {
+		std::cerr << "Usage:\n\t" << argv[0] << " [objects] [max threads]" << std::endl;
+		return 1;
+	}
+
+	//camera at the origin looking down -z (as Scene::Camera does):
+	const float Aspect = 2.0f;
+	glm::mat4 world_to_clip = glm::infinitePerspective(glm::radians(60.0f), Aspect, 0.01f);
+
+	std::mt19937 mt(0x5eed);
+	std::uniform_real_distribution< float > unit(0.0f, 1.0f);
+
+	//occluders: a wall of unit crates, 20 deep in front of the camera, with about one in ten missing:
+	std::vector< Box > occluders;
+	for (int y = -6; y < 6; ++y) {
+		for (int x = -12; x < 12; ++x) {
+			if (unit(mt) < 0.1f) continue;
+			Box box;
+			box.min = glm::vec3(x, y, -21.0f);
+			box.max = box.min + glm::vec3(1.0f);
+			occluders.emplace_back(box);
+		}
+	}
+
+	//objects: small boxes inside the view, from 5 to 200 units away:
+	std::vector< Box > objects;
+	float tan_y = std::tan(glm::radians(30.0f));
+	for (uint32_t i = 0; i < count; ++i) {
+		float depth = 5.0f + 195.0f * unit(mt);
+		glm::vec3 center(
+			(2.0f * unit(mt) - 1.0f) * depth * tan_y * Aspect,
+			(2.0f * unit(mt) - 1.0f) * depth * tan_y,
+			-depth);
+		Box box;
+		box.min = center - glm::vec3(0.25f);
+		box.max = center + glm::vec3(0.25f);
+		objects.emplace_back(box);
+	}
+
+	float overdraw_all = 0.0f;
+	for (auto const &box : objects) {
+		overdraw_all += screen_area(world_to_clip, box);
+	}
+	for (auto const &box : occluders) {
+		overdraw_all += screen_area(world_to_clip, box);
+	}
+
+	std::vector< uint32_t > thread_counts; //(1, 2, 4, ..., max_threads)
+	for (uint32_t threads = 1; threads < max_threads; threads *= 2) {
+		thread_counts.emplace_back(threads);
+	}
+	thread_counts.emplace_back(max_threads);
+
+	std::cout << objects.size() << " objects behind and in front of " << occluders.size() << " occluders; "
+		<< "overdraw without occlusion culling: " << overdraw_all << " screens" << std::endl;
+
+	std::vector< float > reference_depth;
+	std::vector< uint8_t > reference_visible;
+	double one_thread = 0.0;
+	for (uint32_t threads : thread_counts) {
+		WorkerPool pool(threads);
+		OcclusionBuffer buffer;
+		std::vector< uint8_t > visible(objects.size());
+		double best_rasterize = 1e30, best_test = 1e30;
+		for (uint32_t iteration = 0; iteration < 5; ++iteration) {
+			auto before = std::chrono::high_resolution_clock::now();
+			buffer.clear(256, 128);
+			for (auto const &box : occluders) {
+				buffer.add_occluder(world_to_clip, box.min, box.max);
+			}
+			buffer.rasterize(&pool);
+			best_rasterize = std::min(best_rasterize, seconds_since(before));
+
+			before = std::chrono::high_resolution_clock::now();
+			for (size_t i = 0; i < objects.size(); ++i) {
+				visible[i] = buffer.test_box(world_to_clip, objects[i].min, objects[i].max);
+			}
+			best_test = std::min(best_test, seconds_since(before));
+		}
+
+		if (threads == 1) {
+			one_thread = best_rasterize;
+			reference_depth = buffer.depth;
+			reference_visible = visible;
+
+			uint32_t culled = 0;
+			float overdraw = 0.0f;
+			for (auto const &box : occluders) {
+				overdraw += screen_area(world_to_clip, box);
+			}
+			for (size_t i = 0; i < objects.size(); ++i) {
+				if (visible[i]) overdraw += screen_area(world_to_clip, objects[i]);
+				else culled += 1;
+			}
+			std::cout << "culled " << culled << " of " << objects.size() << " objects; "
+				<< "overdraw with occlusion culling: " << overdraw << " screens" << std::endl;
+			std::cout << "testing all objects: " << best_test * 1000.0 << " ms" << std::endl;
+		}
+
+		bool matches = (buffer.depth == reference_depth && visible == reference_visible);
+		std::cout << "  " << threads << " thread" << (threads == 1 ? " " : "s") << ": rasterize " << best_rasterize * 1000.0 << " ms"
+			<< " (" << one_thread / best_rasterize << "x)"
+			<< (matches ? "" : " -- RESULTS DIFFER FROM ONE THREAD") << std::endl;
+	}
+
+	return 0;
+}
@@ -0,0 +1,68 @@
+//optimize-meshes reorders triangles and vertices in a meshes.blob for post-transform cache, overdraw, and fetch efficiency.
+// usage: optimize-meshes <in.blob> <out.blob> [cache size]
+// (triangle-soup meshes are welded first, since the optimizations work on indices)
+
+#include "MeshBlob.hpp"
+#include "MeshOptimize.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <stdexcept>
+#include <cstdlib>
+
+int main(int argc, char **argv) {
+	if (argc != 3 && argc != 4) {
+		std::cerr << "Usage:\n\t" << argv[0] << " <in.blob> <out.blob> [cache size]" << std::endl;
+		return 1;
+	}
+	uint32_t cache_size = 16;
+	if (argc == 4) {
+		cache_size = uint32_t(std::atoi(argv[3]));
+		if (cache_size < 3) {
+			std::cerr << "Cache size must be at least 3." << std::endl;
+			return 1;
+		}
+	}
+
+	try {
+		MeshBlob blob;
+		blob.load(argv[1]);
+
+		VertexCacheStats total_before, total_after;
+		std::cout << std::fixed << std::setprecision(3);
+		for (auto &mesh : blob.meshes) {
+			if (!mesh.indexed) {
+				weld_vertices(blob, &mesh);
+			}
+			VertexCacheStats before = analyze_vertex_cache(mesh.indices, mesh.vertex_count(blob), cache_size);
+
+			std::vector< uint32_t > clusters;
+			optimize_vertex_cache(&mesh.indices, mesh.vertex_count(blob), cache_size, &clusters);
+
+			std::vector< glm::vec3 > positions;
+			positions.reserve(mesh.vertex_count(blob));
+			for (uint32_t v = 0; v < mesh.vertex_count(blob); ++v) {
+				positions.emplace_back(mesh.position(blob, v));
+			}
+			optimize_overdraw(&mesh.indices, positions, clusters);
+
+			optimize_vertex_fetch(blob, &mesh);
+
+			VertexCacheStats after = analyze_vertex_cache(mesh.indices, mesh.vertex_count(blob), cache_size);
+			std::cout << "  '" << mesh.name << "': ACMR " << before.acmr() << " -> " << after.acmr()
+				<< ", ATVR " << before.atvr() << " -> " << after.atvr()
+				<< " (" << clusters.size() << " clusters)" << std::endl;
+
+			total_before.misses += before.misses; total_before.triangles += before.triangles; total_before.vertices += before.vertices;
+			total_after.misses += after.misses; total_after.triangles += after.triangles; total_after.vertices += after.vertices;
+		}
+		std::cout << "Overall (" << cache_size << "-entry FIFO): ACMR " << total_before.acmr() << " -> " << total_after.acmr()
+			<< ", ATVR " << total_before.atvr() << " -> " << total_after.atvr() << std::endl;
+
+		blob.save(argv[2]);
+	} catch (std::exception &e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,121 @@
+//transform-bench times Scene::update_transforms on a synthetic 1M-transform scene with 1 .. N worker threads.
+// usage: transform-bench [transforms] [max threads]
+// two shapes are measured: a "forest" of many small random trees (split by root subtree),
+// and one wide tree (split by depth level). Every parallel result is checked bit-for-bit against
+// the serial make_local_to_world.
+
+#include "Scene.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+
+namespace {
+	//fill 'scene' with 'count' objects; 'parent_of(i)' gives the index of object i's parent (< i), or -1U for a root:
+	template< typename ParentOf >
+	void build(Scene &scene, uint32_t count, ParentOf const &parent_of) {
+		std::mt19937 mt(0x5eed);
+		std::uniform_real_distribution< float > unit(-1.0f, 1.0f);
+		std::vector< Scene::ObjectHandle > handles;
+		handles.reserve(count);
+		for (uint32_t i = 0; i < count; ++i) {
+			handles.emplace_back(scene.objects.emplace());
+			Scene::Transform &transform = scene.objects[handles.back()].transform;
+			transform.set_position(glm::vec3(unit(mt), unit(mt), unit(mt)));
+			transform.set_rotation(glm::normalize(glm::quat(unit(mt), unit(mt), unit(mt), unit(mt))));
+			transform.set_scale(glm::vec3(1.0f + 0.1f * unit(mt)));
+			uint32_t parent = parent_of(i, mt);
+			if (parent != -1U) transform.set_parent(&scene.objects[handles[parent]].transform);
+		}
+	}
+
+	void mark_all_dirty(Scene &scene) {
+		for (auto &object : scene.objects) {
+			if (!object.transform.parent) object.transform.mark_dirty();
+		}
+	}
+
+	void measure(std::string const &name, Scene &scene, uint32_t max_threads) {
+		//reference results:
+		mark_all_dirty(scene);
+		auto before = std::chrono::high_resolution_clock::now();
+		for (auto const &object : scene.objects) {
+			object.transform.make_local_to_world();
+		}
+		auto after = std::chrono::high_resolution_clock::now();
+		double serial = std::chrono::duration< double >(after - before).count();
+		std::vector< Affine > expected;
+		expected.reserve(scene.objects.size());
+		for (auto const &object : scene.objects) {
+			expected.emplace_back(object.transform.make_local_to_world());
+		}
+		std::cout << name << ": " << scene.objects.size() << " transforms; serial make_local_to_world: " << serial * 1000.0 << " ms" << std::endl;
+
+		std::vector< uint32_t > thread_counts; //(1, 2, 4, ..., max_threads)
+		for (uint32_t threads = 1; threads < max_threads; threads *= 2) {
+			thread_counts.emplace_back(threads);
+		}
+		thread_counts.emplace_back(max_threads);
+
+		double one_thread = 0.0;
+		for (uint32_t threads : thread_counts) {
+			WorkerPool pool(threads);
+			double best = 1e30;
+			for (uint32_t iteration = 0; iteration < 5; ++iteration) {
+				mark_all_dirty(scene);
+				auto before = std::chrono::high_resolution_clock::now();
+				scene.update_transforms(pool);
+				auto after = std::chrono::high_resolution_clock::now();
+				best = std::min(best, std::chrono::duration< double >(after - before).count());
+			}
+			if (threads == 1) one_thread = best;
+
+			uint32_t mismatches = 0;
+			auto e = expected.begin();
+			for (auto const &object : scene.objects) {
+				if (object.transform.local_to_world_dirty || std::memcmp(&object.transform.local_to_world, &*e, sizeof(Affine)) != 0) {
+					mismatches += 1;
+				}
+				++e;
+			}
+
+			std::cout << "  " << threads << " thread" << (threads == 1 ? " " : "s") << ": " << best * 1000.0 << " ms"
+				<< " (" << one_thread / best << "x)"
+				<< (mismatches ? " -- " + std::to_string(mismatches) + " MISMATCHED" : "") << std::endl;
+		}
+	}
+}
+
+int main(int argc, char **argv) {
+	uint32_t count = 1000000;
+	uint32_t max_threads = std::max(1U, std::thread::hardware_concurrency());
+	if (argc > 1) count = uint32_t(std::atoi(argv[1]));
+	if (argc > 2) max_threads = uint32_t(std::max(1, std::atoi(argv[2])));
+	if (count == 0) {
+		std::cerr << "Usage:\n\t" << argv[0] << " [transforms] [max threads]" << std::endl;
+		return 1;
+	}
+
+	{ //many small trees (1000 transforms each, each parented to a random earlier transform of its tree):
+		Scene scene;
+		build(scene, count, [](uint32_t i, std::mt19937 &mt) -> uint32_t {
+			uint32_t first = i - i % 1000;
+			if (i == first) return -1U;
+			return first + mt() % (i - first);
+		});
+		measure("forest", scene, max_threads);
+	}
+
+	{ //one wide tree (every transform has 32 children):
+		Scene scene;
+		build(scene, count, [](uint32_t i, std::mt19937 &) -> uint32_t {
+			return (i == 0 ? -1U : (i - 1) / 32);
+		});
+		measure("wide", scene, max_threads);
+	}
+
+	return 0;
+}
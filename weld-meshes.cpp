@@ -0,0 +1,35 @@
+//weld-meshes converts a triangle-soup meshes.blob into an indexed one by merging identical vertices.
+// usage: weld-meshes <in.blob> <out.blob>
+
+#include "MeshBlob.hpp"
+
+#include <iostream>
+#include <stdexcept>
+
+int main(int argc, char **argv) {
+	if (argc != 3) {
+		std::cerr << "Usage:\n\t" << argv[0] << " <in.blob> <out.blob>" << std::endl;
+		return 1;
+	}
+
+	try {
+		MeshBlob blob;
+		blob.load(argv[1]);
+
+		uint64_t before = 0, after = 0;
+		for (auto &mesh : blob.meshes) {
+			uint32_t count = mesh.vertex_count(blob);
+			uint32_t removed = weld_vertices(blob, &mesh);
+			std::cout << "  '" << mesh.name << "': " << count << " -> " << (count - removed) << " vertices, " << mesh.indices.size() << " indices" << std::endl;
+			before += count;
+			after += count - removed;
+		}
+		std::cout << "Welded " << before << " vertices down to " << after << "." << std::endl;
+
+		blob.save(argv[2]);
+	} catch (std::exception &e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+	return 0;
+}